@@ -23,9 +23,11 @@ setup() {
             clang-tidy-9 \
             cmake \
             libmpdclient-dev \
+            libzstd-dev \
             ninja-build \
             patchelf \
             python3 python3-pip python3-setuptools python3-wheel \
+            zlib1g-dev \
     || die "couldn't apt-get required packages" 
     sudo pip3 install meson=="${MESON_VERSION}" || die "couldn't install meson"
     build_meta
@@ -0,0 +1,36 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ashuffle {
+
+std::string_view StringArena::Append(std::string_view str) {
+    // +1 for the trailing NUL.
+    size_t need = str.size() + 1;
+    if (need > remaining_) {
+        size_t last_size = blocks_.empty() ? 0 : allocated_;
+        size_t block_size = std::clamp(last_size, kMinBlockSize, kMaxBlockSize);
+        // Strings bigger than a whole block get a block of their own.
+        block_size = std::max(block_size, need);
+        blocks_.emplace_back(new char[block_size]);
+        next_ = blocks_.back().get();
+        remaining_ = block_size;
+        allocated_ += block_size;
+    }
+    char* dest = next_;
+    std::memcpy(dest, str.data(), str.size());
+    dest[str.size()] = '\0';
+    next_ += need;
+    remaining_ -= need;
+    return std::string_view(dest, str.size());
+}
+
+void StringArena::Clear() {
+    blocks_.clear();
+    next_ = nullptr;
+    remaining_ = 0;
+    allocated_ = 0;
+}
+
+}  // namespace ashuffle
@@ -0,0 +1,56 @@
+#ifndef __ASHUFFLE_ARENA_H__
+#define __ASHUFFLE_ARENA_H__
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace ashuffle {
+
+// StringArena stores strings in large, contiguous, blocks of memory, rather
+// than using one heap allocation per string. Strings stored in the arena
+// are never moved, so the views returned by `Append` remain valid until the
+// arena is cleared or destroyed.
+class StringArena {
+   public:
+    StringArena() = default;
+
+    // The arena owns its blocks, and views point into them. Copying would
+    // leave the copied views pointing at the original arena.
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    // Moves are fine, since moving the block vector does not move the
+    // blocks themselves.
+    StringArena(StringArena&&) = default;
+    StringArena& operator=(StringArena&&) = default;
+
+    // Append copies the given string into the arena, and returns a view of
+    // the copy. The copy is always followed by a NUL byte, so the view's
+    // data() may be used as a C string.
+    std::string_view Append(std::string_view str);
+
+    // Release all storage held by this arena. All views previously returned
+    // by `Append` are invalidated.
+    void Clear();
+
+    // Returns the number of bytes allocated by this arena.
+    size_t Allocated() const { return allocated_; }
+
+   private:
+    // Blocks start small, so that small arenas stay small, and double in
+    // size up to kMaxBlockSize, so that big arenas need few allocations.
+    static constexpr size_t kMinBlockSize = 4 * 1024;
+    static constexpr size_t kMaxBlockSize = 1024 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    // Space left in the last block, starting at `next_`.
+    char* next_ = nullptr;
+    size_t remaining_ = 0;
+    size_t allocated_ = 0;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_ARENA_H__
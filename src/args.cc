@@ -5,6 +5,7 @@
 #include <memory>
 #include <ostream>
 #include <string_view>
+#include <thread>
 
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_format.h>
@@ -20,7 +21,7 @@ namespace {
 constexpr char kHelpMessage[] =
     "usage: ashuffle [-h] [-n] [[-e PATTERN ...] ...] [-o NUMBER] "
     "[-f FILENAME] [-q NUMBER]\n"
-    "    [-g TAG ...] [[-t TWEAK] ...]\n"
+    "    [-g TAG ...] [--spread-by TAG ...] [[-t TWEAK] ...]\n"
     "\n"
     "Optional Arguments:\n"
     "   -h,-?,--help      Display this help message.\n"
@@ -50,6 +51,9 @@ constexpr char kHelpMessage[] =
     "                     the currently playing song. This is to support MPD\n"
     "                     features like crossfade that don't work if there\n"
     "                     are no more songs in the queue.\n"
+    "   --spread-by       Avoid picking songs that share a value of any of\n"
+    "                     the given tags (e.g. 'artist') soon after one\n"
+    "                     another. See `readme.md` for details.\n"
     "   -t,--tweak        Tweak an infrequently used ashuffle option. See\n"
     "                     `readme.md` for a list of available options.\n"
     "See included `readme.md` file for PATTERN syntax.\n";
@@ -107,6 +111,8 @@ class Parser {
         kRule,         // (generic) Expecting rule tag
         kRuleBegin,    // Expecting first rule tag (not generic)
         kRuleValue,    // Expecting rule matcher for previous tag
+        kSpread,       // (generic) Expecting tag to spread by.
+        kSpreadBegin,  // Expecting first tag to spread by.
         kTest,         // Expecting test-only flag name
         kTweak,        // Expecting a tweak
     };
@@ -144,7 +150,8 @@ class Parser {
 };
 
 bool Parser::InGenericState() {
-    return state_ == kNone || state_ == kRule || state_ == kGroup;
+    return state_ == kNone || state_ == kRule || state_ == kGroup ||
+           state_ == kSpread;
 }
 
 bool Parser::InFinalState() { return state_ == kFinal || state_ == kError; }
@@ -242,6 +249,103 @@ std::variant<Parser::State, ParseError> Parser::ParseTweak(
         return kNone;
     }
 
+    if (key == "full-cycle") {
+        auto v = ParseBool(value);
+        if (!v) {
+            return ParseError(absl::StrFormat(
+                "full-cycle must be a boolean value ('%s' given)", value));
+        }
+        opts_.tweak.full_cycle = *v;
+        return kNone;
+    }
+
+    if (key == "pool-compression") {
+        if (value == "none") {
+            opts_.tweak.pool_compression = PoolCompression::kNone;
+        } else if (value == "front") {
+            opts_.tweak.pool_compression = PoolCompression::kFront;
+        } else {
+            return ParseError(absl::StrFormat(
+                "pool-compression must be one of 'none' or 'front' "
+                "('%s' given)",
+                value));
+        }
+        return kNone;
+    }
+
+    if (key == "spread-distance") {
+        if (!absl::SimpleAtoi(value, &opts_.tweak.spread_distance)) {
+            return ParseError(absl::StrFormat(
+                "couldn't convert spread-distance value '%s'", value));
+        }
+        if (opts_.tweak.spread_distance < 1) {
+            return ParseError(absl::StrFormat(
+                "tweak spread-distance must be >= 1 (%s given)", value));
+        }
+        return kNone;
+    }
+
+    if (key == "stream-startup") {
+        if (!absl::SimpleAtoi(value, &opts_.tweak.stream_startup)) {
+            return ParseError(absl::StrFormat(
+                "couldn't convert stream-startup value '%s'", value));
+        }
+        return kNone;
+    }
+
+    if (key == "stream-startup-ms") {
+        if (!absl::SimpleAtoi(value, &opts_.tweak.stream_startup_ms)) {
+            return ParseError(absl::StrFormat(
+                "couldn't convert stream-startup-ms value '%s'", value));
+        }
+        if (opts_.tweak.stream_startup_ms < 1) {
+            return ParseError(absl::StrFormat(
+                "tweak stream-startup-ms must be >= 1 (%s given)", value));
+        }
+        return kNone;
+    }
+
+    if (key == "load-threads") {
+        if (!absl::SimpleAtoi(value, &opts_.tweak.load_threads)) {
+            return ParseError(absl::StrFormat(
+                "couldn't convert load-threads value '%s'", value));
+        }
+        if (opts_.tweak.load_threads < 1) {
+            return ParseError(absl::StrFormat(
+                "tweak load-threads must be >= 1 (%s given)", value));
+        }
+        // More threads than cores only add overhead, and a typo'd huge
+        // count would fail to start its threads, so counts are capped.
+        unsigned max_threads =
+            std::max(1u, std::thread::hardware_concurrency()) * 4;
+        if (opts_.tweak.load_threads > max_threads) {
+            return ParseError(absl::StrFormat(
+                "tweak load-threads must be <= %u (%s given)", max_threads,
+                value));
+        }
+        return kNone;
+    }
+
+    if (key == "state-file") {
+        opts_.tweak.state_file = value;
+        return kNone;
+    }
+
+    if (key == "library-cache") {
+        opts_.tweak.library_cache = value;
+        return kNone;
+    }
+
+    if (key == "seed") {
+        uint64_t seed;
+        if (!absl::SimpleAtoi(value, &seed)) {
+            return ParseError(
+                absl::StrFormat("couldn't convert seed value '%s'", value));
+        }
+        opts_.tweak.seed = seed;
+        return kNone;
+    }
+
     return ParseError(absl::StrFormat("unrecognized tweak '%s'", arg));
 }
 
@@ -293,6 +397,13 @@ std::variant<Parser::State, ParseError> Parser::ConsumeInternal(
             opts_.group_by.push_back(MPD_TAG_DATE);
             return kNone;
         }
+        if (arg == "--spread-by") {
+            if (!opts_.spread_by.empty()) {
+                return ParseError(
+                    absl::StrFormat("'%s' can only be provided once", arg));
+            }
+            return kSpreadBegin;
+        }
         if (arg == "--tweak" || arg == "-t") {
             return kTweak;
         }
@@ -305,6 +416,7 @@ std::variant<Parser::State, ParseError> Parser::ConsumeInternal(
                 opts_.file_in = &std::cin;
             } else {
                 std::string filepath(arg);
+                opts_.file_path = filepath;
                 opts_.InternalTakeIstream(
                     std::make_unique<std::ifstream>(filepath));
             }
@@ -359,6 +471,16 @@ std::variant<Parser::State, ParseError> Parser::ConsumeInternal(
             opts_.group_by.push_back(*tag);
             return kGroup;
         }
+        case kSpread:
+        case kSpreadBegin: {
+            std::optional<enum mpd_tag_type> tag = tag_parser_.Parse(arg);
+            if (!tag) {
+                return ParseError(
+                    absl::StrFormat("invalid tag name '%s'", arg));
+            }
+            opts_.spread_by.push_back(*tag);
+            return kSpread;
+        }
         case kFinal:
         case kError:
             assert(false && "unreachable, should not be possible");
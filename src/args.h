@@ -10,6 +10,7 @@
 
 #include "mpd.h"
 #include "rule.h"
+#include "shuffle.h"
 
 namespace ashuffle {
 
@@ -32,6 +33,9 @@ class Options {
     std::vector<Rule> ruleset;
     unsigned queue_only = 0;
     std::istream *file_in = nullptr;
+    // The path of the file given with --file, unless it is stdin. Loaders
+    // read the file from its path, so that it can be mapped into memory.
+    std::string file_path;
     bool check_uris = true;
     unsigned queue_buffer = 0;
     std::optional<std::string> host = {};
@@ -48,8 +52,37 @@ class Options {
         // Otherwise, ashuffle will wait for an MPD event before playing
         // music.
         bool play_on_startup = true;
+        // If true, the shuffle chain runs in full-cycle mode, and every
+        // song is picked once before any song is repeated. The window size
+        // is ignored.
+        bool full_cycle = false;
+        // How the shuffle chain should store the URIs in its pool.
+        PoolCompression pool_compression = PoolCompression::kNone;
+        // The number of picks within which `spread_by` tag values are not
+        // repeated.
+        int spread_distance = 7;
+        // If set, the seed used for the shuffle chain's random number
+        // generator. Runs with the same seed (and library) pick the same
+        // songs.
+        std::optional<uint64_t> seed;
+        // If set, the path of the file used to persist the state of the
+        // shuffle chain across restarts.
+        std::string state_file;
+        // If set, the path of the file used to cache the songs loaded from
+        // MPD across restarts.
+        std::string library_cache;
+        // If non-zero, the library is loaded in the background, and
+        // ashuffle starts once this many songs are loaded, or once
+        // stream_startup_ms have passed, whichever comes first.
+        unsigned stream_startup = 0;
+        int stream_startup_ms = 1000;
+        // The number of threads used to check songs against the ruleset
+        // while the library loads. 0 or 1 checks songs on the thread that
+        // reads them.
+        unsigned load_threads = 1;
     } tweak = {};
     std::vector<enum mpd_tag_type> group_by = {};
+    std::vector<enum mpd_tag_type> spread_by = {};
 
     // Parse parses the arguments in the given vector and returns ParseResult
     // based on the success/failure of the parse.
@@ -8,8 +8,10 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <absl/strings/str_format.h>
+#include <absl/types/span.h>
 #include <mpd/idle.h>
 
 #include "args.h"
@@ -19,6 +21,7 @@
 #include "mpd_client.h"
 #include "rule.h"
 #include "shuffle.h"
+#include "state_file.h"
 #include "util.h"
 
 namespace ashuffle {
@@ -43,7 +46,12 @@ void TryFirst(mpd::MPD *mpd, ShuffleChain *songs) {
     mpd->PlayAt(status->QueueLength());
 }
 
-void TryEnqueue(mpd::MPD *mpd, ShuffleChain *songs, const Options &options) {
+// `picked` is a buffer for the picked URIs, that is re-used across calls.
+// The URIs in it point into the chain, so they are only valid until the
+// next drain of a background load adds items. Returns true if any songs
+// were picked.
+bool TryEnqueue(mpd::MPD *mpd, ShuffleChain *songs, const Options &options,
+                std::vector<std::string_view> *picked) {
     std::unique_ptr<mpd::Status> status = mpd->CurrentStatus();
 
     // We're "past" the last song, if there is no current song position.
@@ -72,6 +80,7 @@ void TryEnqueue(mpd::MPD *mpd, ShuffleChain *songs, const Options &options) {
     }
 
     /* Add another song to the list and restart the player */
+    bool added = false;
     if (should_add) {
         if (options.queue_buffer != 0) {
             int needed = static_cast<int>(options.queue_buffer) -
@@ -82,13 +91,14 @@ void TryEnqueue(mpd::MPD *mpd, ShuffleChain *songs, const Options &options) {
             if (past_last || queue_empty) {
                 needed += 1;
             }
-            while (needed > 0) {
-                std::vector<std::string> picked = songs->Pick();
-                needed -= static_cast<int>(picked.size());
-                mpd->Add(picked);
+            if (needed > 0) {
+                songs->PickURIs(static_cast<size_t>(needed), picked);
+                mpd->Add(*picked);
+                added = true;
             }
         } else {
             mpd->Add(songs->Pick());
+            added = true;
         }
     }
 
@@ -104,6 +114,7 @@ void TryEnqueue(mpd::MPD *mpd, ShuffleChain *songs, const Options &options) {
             mpd->Pause();
         }
     }
+    return added;
 }
 
 void PromptPassword(mpd::MPD *mpd, std::function<std::string()> &getpass_f) {
@@ -137,32 +148,65 @@ struct MPDHost {
 
 /* Keep adding songs when the queue runs out */
 void Loop(mpd::MPD *mpd, ShuffleChain *songs, const Options &options,
-          TestDelegate test_d) {
+          Loader *loader, TestDelegate test_d, BackgroundLoad *load) {
     static_assert(MPD_IDLE_QUEUE == MPD_IDLE_PLAYLIST,
                   "QUEUE Now different signal.");
     mpd::IdleEventSet set(MPD_IDLE_DATABASE, MPD_IDLE_QUEUE, MPD_IDLE_PLAYER);
+    std::vector<std::string_view> picked;
+
+    // The chain only changes when songs are picked, or the library is
+    // reloaded, so saving after each of those keeps the state file current.
+    // Other events (e.g., pausing) don't re-write it.
+    std::optional<StateFile> state;
+    if (!options.tweak.state_file.empty()) {
+        state.emplace(options.tweak.state_file);
+    }
+    auto save_state = [&state, songs] {
+        if (!state) {
+            return;
+        }
+        if (std::optional<std::string> err = state->Save(*songs); err) {
+            std::cerr << "warning: " << *err << std::endl;
+        }
+    };
+
+    auto drain = [&load, songs] {
+        if (load == nullptr || !load->Drain()) {
+            return;
+        }
+        load = nullptr;
+        // Compress the pool (if enabled) now that it's complete.
+        songs->Compact();
+        std::cout << "Picking random songs out of a pool of " << songs->Len()
+                  << "." << std::endl;
+    };
 
     // If the test delegate's `skip_init` is set to true, then skip the
     // initializer.
+    drain();
     if (options.tweak.play_on_startup) {
         TryFirst(mpd, songs);
-        TryEnqueue(mpd, songs, options);
+        TryEnqueue(mpd, songs, options, &picked);
+        save_state();
     }
 
     // Loop forever if test delegates are not set.
     while (test_d.until_f == nullptr || test_d.until_f()) {
         /* wait till the player state changes */
         mpd::IdleEventSet events = mpd->Idle(set);
-        /* Only update the database if our original list was built from
-         * MPD. */
-        if (events.Has(MPD_IDLE_DATABASE) && options.file_in == nullptr) {
-            songs->Clear();
-            MPDLoader loader(mpd, options.ruleset);
-            loader.Load(songs);
+        drain();
+        if (events.Has(MPD_IDLE_DATABASE) && loader != nullptr) {
+            // Reload into the existing chain, rather than clearing it, so
+            // that songs that are still in the library keep their place in
+            // the window.
+            loader->Reload(songs);
             std::cout << "Picking random songs out of a pool of "
                       << songs->Len() << "." << std::endl;
+            save_state();
         } else if (events.Has(MPD_IDLE_QUEUE) || events.Has(MPD_IDLE_PLAYER)) {
-            TryEnqueue(mpd, songs, options);
+            if (TryEnqueue(mpd, songs, options, &picked)) {
+                save_state();
+            }
         }
     }
 }
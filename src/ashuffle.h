@@ -9,6 +9,7 @@
 #include <mpd/client.h>
 
 #include "args.h"
+#include "load.h"
 #include "mpd.h"
 #include "rule.h"
 #include "shuffle.h"
@@ -27,11 +28,16 @@ struct TestDelegate {
 };
 
 // Use the MPD `idle` command to queue songs random songs when the current
-// queue finishes playing. This is the core loop of `ashuffle`. The tests
+// queue finishes playing. This is the core loop of `ashuffle`. When MPD's
+// database changes, `songs` is reloaded with `loader`, which should be the
+// loader `songs` was loaded with, or nullptr to never reload. The tests
 // delegate is used during tests to observe loop effects. It should be set to
-// NULL during normal operations.
+// NULL during normal operations. If `load` is given, songs are still being
+// loaded into `songs` in the background, and newly loaded songs are added
+// to the chain before songs are picked.
 void Loop(mpd::MPD* mpd, ShuffleChain* songs, const Options& options,
-          TestDelegate d = TestDelegate());
+          Loader* loader, TestDelegate d = TestDelegate(),
+          BackgroundLoad* load = nullptr);
 
 }  // namespace ashuffle
 
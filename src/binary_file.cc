@@ -0,0 +1,86 @@
+#include "binary_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <absl/strings/str_format.h>
+
+namespace ashuffle {
+
+namespace {
+
+// Write all of `data` to the given file descriptor.
+bool WriteAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = write(fd, data.data(), data.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        data.remove_prefix(n);
+    }
+    return true;
+}
+
+}  // namespace
+
+void PutString(std::string* out, std::string_view s) {
+    PutInt<uint32_t>(out, s.size());
+    out->append(s);
+}
+
+std::string_view BinaryReader::GetString() {
+    uint32_t size = Get<uint32_t>();
+    if (data.size() < size) {
+        ok = false;
+        return {};
+    }
+    std::string_view s = data.substr(0, size);
+    data.remove_prefix(size);
+    return s;
+}
+
+std::string ErrnoMessage(std::string_view what, std::string_view path) {
+    return absl::StrFormat("%s '%s': %s", what, path, strerror(errno));
+}
+
+std::optional<std::string> WriteFileAtomic(
+    const std::string& path, std::string_view what,
+    absl::Span<const std::string_view> parts) {
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return ErrnoMessage(absl::StrFormat("failed to create %s", what), tmp);
+    }
+    bool written = true;
+    for (std::string_view part : parts) {
+        written = written && WriteAll(fd, part);
+    }
+    if (!written || fsync(fd) != 0) {
+        std::string err =
+            ErrnoMessage(absl::StrFormat("failed to write %s", what), tmp);
+        close(fd);
+        unlink(tmp.c_str());
+        return err;
+    }
+    if (close(fd) != 0) {
+        std::string err =
+            ErrnoMessage(absl::StrFormat("failed to write %s", what), tmp);
+        unlink(tmp.c_str());
+        return err;
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        std::string err =
+            ErrnoMessage(absl::StrFormat("failed to replace %s", what), path);
+        unlink(tmp.c_str());
+        return err;
+    }
+    return std::nullopt;
+}
+
+}  // namespace ashuffle
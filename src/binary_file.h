@@ -0,0 +1,68 @@
+#ifndef __ASHUFFLE_BINARY_FILE_H__
+#define __ASHUFFLE_BINARY_FILE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <absl/types/span.h>
+
+namespace ashuffle {
+
+// Helpers for the binary files ashuffle persists across restarts (state
+// checkpoints, and library caches). All integers are little-endian.
+
+// Append `v` to `out`.
+template <typename T>
+void PutInt(std::string* out, T v) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        out->push_back(static_cast<char>(v >> (8 * i)));
+    }
+}
+
+// Append `s` to `out`, prefixed by its length, as a uint32_t.
+void PutString(std::string* out, std::string_view s);
+
+// BinaryReader reads the integers, and strings, written by PutInt and
+// PutString. Reading past the end of the data sets `ok` to false, and
+// returns zeros, or empty strings.
+struct BinaryReader {
+    std::string_view data;
+    bool ok = true;
+
+    template <typename T>
+    T Get() {
+        if (data.size() < sizeof(T)) {
+            ok = false;
+            return 0;
+        }
+        T v = 0;
+        for (size_t i = 0; i < sizeof(T); i++) {
+            v |= static_cast<T>(static_cast<unsigned char>(data[i])) << (8 * i);
+        }
+        data.remove_prefix(sizeof(T));
+        return v;
+    }
+
+    // Returns a view of the string, which points into `data`.
+    std::string_view GetString();
+};
+
+// Returns an error message for the current errno, of the form
+// "<what> '<path>': <error>".
+std::string ErrnoMessage(std::string_view what, std::string_view path);
+
+// Replace the file at `path` with the concatenation of `parts`, atomically:
+// the parts are written to a temporary file in the same directory, synced,
+// and renamed over `path`, so a crash never leaves a partially written file
+// behind. `what` names the file in error messages (e.g., "state file").
+// Returns an error message on failure.
+std::optional<std::string> WriteFileAtomic(
+    const std::string& path, std::string_view what,
+    absl::Span<const std::string_view> parts);
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_BINARY_FILE_H__
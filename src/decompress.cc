@@ -0,0 +1,243 @@
+#include "decompress.h"
+
+#include <algorithm>
+
+#ifdef ASHUFFLE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ASHUFFLE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace ashuffle {
+
+namespace {
+
+// Decompressed data is published in blocks of this size.
+constexpr size_t kBlockSize = 1024 * 1024;
+
+// The most blocks decompressed ahead of the reader.
+constexpr size_t kMaxBlocks = 4;
+
+// Compressed data is read in blocks of this size.
+constexpr size_t kInputSize = 256 * 1024;
+
+}  // namespace
+
+Compression DetectCompression(std::string_view head) {
+    if (head.substr(0, 2) == "\x1f\x8b") {
+        return Compression::kGzip;
+    }
+    if (head.substr(0, 4) == "\x28\xb5\x2f\xfd") {
+        return Compression::kZstd;
+    }
+    return Compression::kNone;
+}
+
+Decompressor::Decompressor(Compression compression, ReadFunc read)
+    : read_(std::move(read)) {
+    thread_ = std::thread([this, compression] { Run(compression); });
+}
+
+Decompressor::~Decompressor() {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    consumed_.notify_all();
+    thread_.join();
+}
+
+size_t Decompressor::Read(char* buf, size_t size) {
+    size_t done = 0;
+    std::unique_lock<std::mutex> lock(mu_);
+    while (done < size) {
+        published_.wait(lock, [this] { return !blocks_.empty() || done_; });
+        if (blocks_.empty()) {
+            break;
+        }
+        const std::vector<char>& block = blocks_.front();
+        size_t n = std::min(size - done, block.size() - offset_);
+        std::copy_n(block.data() + offset_, n, buf + done);
+        done += n;
+        offset_ += n;
+        if (offset_ == block.size()) {
+            blocks_.pop_front();
+            offset_ = 0;
+            consumed_.notify_one();
+        }
+    }
+    return done;
+}
+
+std::optional<std::string> Decompressor::Error() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return error_;
+}
+
+bool Decompressor::Publish(std::vector<char> block) {
+    std::unique_lock<std::mutex> lock(mu_);
+    consumed_.wait(lock,
+                   [this] { return blocks_.size() < kMaxBlocks || stop_; });
+    if (stop_) {
+        return false;
+    }
+    blocks_.push_back(std::move(block));
+    published_.notify_one();
+    return true;
+}
+
+void Decompressor::Run(Compression compression) {
+    if (compression == Compression::kGzip) {
+        RunGzip();
+    } else if (compression == Compression::kZstd) {
+        RunZstd();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        done_ = true;
+    }
+    published_.notify_one();
+}
+
+#ifdef ASHUFFLE_HAVE_ZLIB
+
+void Decompressor::RunGzip() {
+    std::optional<std::string> error;
+    z_stream zs = {};
+    // Adding 32 to the window bits makes zlib expect a gzip (or zlib)
+    // header.
+    if (inflateInit2(&zs, MAX_WBITS + 32) != Z_OK) {
+        std::lock_guard<std::mutex> lock(mu_);
+        error_ = "could not start gzip decompression";
+        return;
+    }
+    std::vector<char> in(kInputSize);
+    std::vector<char> out(kBlockSize);
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = out.size();
+    bool eof = false;
+    // True at the end of a gzip stream, before the next one (if any).
+    bool stream_end = false;
+    // True if the last call filled the output, so zlib may still hold
+    // output, even if there is no more input.
+    bool full = false;
+    for (;;) {
+        if (zs.avail_in == 0 && !eof) {
+            size_t n = read_(in.data(), in.size());
+            eof = n < in.size();
+            zs.next_in = reinterpret_cast<Bytef*>(in.data());
+            zs.avail_in = n;
+        }
+        if (zs.avail_in == 0 && eof && !full) {
+            if (!stream_end) {
+                error = "gzip data is truncated";
+            }
+            break;
+        }
+        if (stream_end && zs.avail_in > 0) {
+            inflateReset(&zs);
+            stream_end = false;
+        }
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            stream_end = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            error = zs.msg != nullptr ? zs.msg : "gzip data is corrupt";
+            break;
+        }
+        full = zs.avail_out == 0;
+        if (full) {
+            if (!Publish(std::move(out))) {
+                inflateEnd(&zs);
+                return;
+            }
+            out = std::vector<char>(kBlockSize);
+            zs.next_out = reinterpret_cast<Bytef*>(out.data());
+            zs.avail_out = out.size();
+        }
+    }
+    out.resize(out.size() - zs.avail_out);
+    inflateEnd(&zs);
+    if (!out.empty() && !Publish(std::move(out))) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    error_ = error;
+}
+
+#else
+
+void Decompressor::RunGzip() {
+    std::lock_guard<std::mutex> lock(mu_);
+    error_ = "data is gzip-compressed, but ashuffle was built without zlib";
+}
+
+#endif  // ASHUFFLE_HAVE_ZLIB
+
+#ifdef ASHUFFLE_HAVE_ZSTD
+
+void Decompressor::RunZstd() {
+    std::optional<std::string> error;
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (dctx == nullptr) {
+        std::lock_guard<std::mutex> lock(mu_);
+        error_ = "could not start zstd decompression";
+        return;
+    }
+    std::vector<char> in(kInputSize);
+    std::vector<char> out(kBlockSize);
+    ZSTD_inBuffer input = {in.data(), 0, 0};
+    ZSTD_outBuffer output = {out.data(), out.size(), 0};
+    bool eof = false;
+    // Zero at the end of a zstd frame.
+    size_t hint = 0;
+    // True if the last call filled the output, so zstd may still hold
+    // output, even if there is no more input.
+    bool full = false;
+    for (;;) {
+        if (input.pos == input.size && !eof) {
+            size_t n = read_(in.data(), in.size());
+            eof = n < in.size();
+            input = {in.data(), n, 0};
+        }
+        if (input.pos == input.size && eof && !full) {
+            if (hint != 0) {
+                error = "zstd data is truncated";
+            }
+            break;
+        }
+        hint = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(hint)) {
+            error = ZSTD_getErrorName(hint);
+            break;
+        }
+        full = output.pos == output.size;
+        if (full) {
+            if (!Publish(std::move(out))) {
+                ZSTD_freeDCtx(dctx);
+                return;
+            }
+            out = std::vector<char>(kBlockSize);
+            output = {out.data(), out.size(), 0};
+        }
+    }
+    out.resize(output.pos);
+    ZSTD_freeDCtx(dctx);
+    if (!out.empty() && !Publish(std::move(out))) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    error_ = error;
+}
+
+#else
+
+void Decompressor::RunZstd() {
+    std::lock_guard<std::mutex> lock(mu_);
+    error_ = "data is zstd-compressed, but ashuffle was built without zstd";
+}
+
+#endif  // ASHUFFLE_HAVE_ZSTD
+
+}  // namespace ashuffle
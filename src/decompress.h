@@ -0,0 +1,85 @@
+#ifndef __ASHUFFLE_DECOMPRESS_H__
+#define __ASHUFFLE_DECOMPRESS_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace ashuffle {
+
+// A ReadFunc fills the given buffer, and returns the number of bytes read.
+// Fewer bytes than requested are only read at the end of the data.
+using ReadFunc = std::function<size_t(char*, size_t)>;
+
+enum class Compression {
+    kNone,
+    kGzip,
+    kZstd,
+};
+
+// The number of leading bytes needed to detect the compression of data.
+constexpr size_t kCompressionMagicSize = 4;
+
+// Returns the compression of data that starts with `head`, from its magic
+// number.
+Compression DetectCompression(std::string_view head);
+
+// Decompressor decompresses data read from a ReadFunc. Data is decompressed
+// on its own thread, a few blocks ahead of the reader, so that
+// decompression overlaps with whatever the reader does with the data.
+// Concatenated streams (e.g., from `cat a.gz b.gz`) are decompressed one
+// after another, like zcat does.
+class Decompressor {
+   public:
+    // Start decompressing the data read with `read`, which is compressed
+    // with `compression` (which must not be kNone).
+    Decompressor(Compression compression, ReadFunc read);
+
+    // Stops decompressing, if the reader stops early.
+    ~Decompressor();
+
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    // Read decompressed data. Like a ReadFunc, fewer bytes than requested
+    // are only read at the end of the data, or on an error.
+    size_t Read(char* buf, size_t size);
+
+    // Returns the error that ended the data early, if any (e.g., corrupt
+    // data, or a format ashuffle was built without support for). Only
+    // valid once Read has read less than requested.
+    std::optional<std::string> Error();
+
+   private:
+    // Runs on the decompression thread.
+    void Run(Compression compression);
+    void RunGzip();
+    void RunZstd();
+
+    // Publish a block of decompressed data, waiting while the reader is
+    // too far behind. Returns false if the reader stopped.
+    bool Publish(std::vector<char> block);
+
+    ReadFunc read_;
+    std::mutex mu_;
+    std::condition_variable published_;
+    std::condition_variable consumed_;
+    // Decompressed blocks, and how much of the first one was read.
+    std::deque<std::vector<char>> blocks_;
+    size_t offset_ = 0;
+    bool done_ = false;
+    bool stop_ = false;
+    std::optional<std::string> error_;
+    std::thread thread_;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_DECOMPRESS_H__
@@ -0,0 +1,87 @@
+#include "fenwick.h"
+
+#include <cassert>
+
+namespace ashuffle {
+
+namespace {
+
+// Returns the lowest set bit of `i`.
+size_t LowBit(size_t i) { return i & (~i + 1); }
+
+}  // namespace
+
+FenwickTree::FenwickTree(const std::vector<uint64_t>& weights)
+    : tree_(weights) {
+    // Each node pushes its (complete) sum up to its parent, which is always
+    // later in the array.
+    for (size_t i = 1; i <= tree_.size(); i++) {
+        total_ += weights[i - 1];
+        size_t parent = i + LowBit(i);
+        if (parent <= tree_.size()) {
+            tree_[parent - 1] += tree_[i - 1];
+        }
+    }
+}
+
+void FenwickTree::PushBack(uint64_t weight) {
+    size_t i = tree_.size() + 1;
+    // The new node covers (i - lowbit(i), i], all of which except `i`
+    // itself are already in the tree.
+    tree_.push_back(weight + Prefix(i - 1) - Prefix(i - LowBit(i)));
+    total_ += weight;
+}
+
+void FenwickTree::PopBack() {
+    assert(!tree_.empty() && "pop from empty tree");
+    // No other node covers the last index, so it can simply be dropped.
+    total_ -= Get(tree_.size() - 1);
+    tree_.pop_back();
+}
+
+void FenwickTree::Add(size_t i, int64_t delta) {
+    assert(i < tree_.size() && "index out of range");
+    // Adding a negative delta relies on (well defined) unsigned wraparound.
+    auto udelta = static_cast<uint64_t>(delta);
+    for (size_t n = i + 1; n <= tree_.size(); n += LowBit(n)) {
+        tree_[n - 1] += udelta;
+    }
+    total_ += udelta;
+}
+
+uint64_t FenwickTree::Get(size_t i) const { return Prefix(i + 1) - Prefix(i); }
+
+uint64_t FenwickTree::Prefix(size_t n) const {
+    assert(n <= tree_.size() && "index out of range");
+    uint64_t sum = 0;
+    for (; n > 0; n -= LowBit(n)) {
+        sum += tree_[n - 1];
+    }
+    return sum;
+}
+
+size_t FenwickTree::Find(uint64_t target) const {
+    assert(target < total_ && "target out of range");
+    size_t step = 1;
+    while (step * 2 <= tree_.size()) {
+        step *= 2;
+    }
+    // Walk down the implicit tree, keeping `pos` as the largest index with
+    // Prefix(pos) <= target.
+    size_t pos = 0;
+    for (; step > 0; step /= 2) {
+        size_t next = pos + step;
+        if (next <= tree_.size() && tree_[next - 1] <= target) {
+            pos = next;
+            target -= tree_[next - 1];
+        }
+    }
+    return pos;
+}
+
+void FenwickTree::Clear() {
+    tree_.clear();
+    total_ = 0;
+}
+
+}  // namespace ashuffle
@@ -0,0 +1,59 @@
+#ifndef __ASHUFFLE_FENWICK_H__
+#define __ASHUFFLE_FENWICK_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ashuffle {
+
+// FenwickTree (or binary indexed tree) stores a list of non-negative integer
+// weights, and supports updating a weight, appending a weight, and finding
+// the item at a given cumulative weight, all in O(log n) time. It is used
+// to sample items in proportion to their weight.
+class FenwickTree {
+   public:
+    FenwickTree() = default;
+
+    // Build a tree holding the given weights. Takes O(n) time.
+    explicit FenwickTree(const std::vector<uint64_t>& weights);
+
+    // Returns the number of weights in this tree.
+    size_t Size() const { return tree_.size(); }
+
+    // Returns the sum of all weights in this tree.
+    uint64_t Total() const { return total_; }
+
+    // Append a new weight to the end of the tree.
+    void PushBack(uint64_t weight);
+
+    // Remove the last weight from the tree.
+    void PopBack();
+
+    // Add `delta` to the weight at index `i`. The resulting weight must not
+    // be negative.
+    void Add(size_t i, int64_t delta);
+
+    // Returns the weight at index `i`.
+    uint64_t Get(size_t i) const;
+
+    // Returns the sum of the first `n` weights.
+    uint64_t Prefix(size_t n) const;
+
+    // Returns the index of the item that covers `target`, i.e., the smallest
+    // `i` such that Prefix(i + 1) > target. `target` must be less than
+    // Total(). Items with a weight of zero are never returned.
+    size_t Find(uint64_t target) const;
+
+    // Remove all weights from this tree.
+    void Clear();
+
+   private:
+    // tree_[i] holds the sum of the weights in (i + 1 - lowbit(i + 1), i].
+    std::vector<uint64_t> tree_;
+    uint64_t total_ = 0;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_FENWICK_H__
@@ -0,0 +1,65 @@
+#include "fingerprint.h"
+
+#include <cstddef>
+
+namespace ashuffle {
+
+namespace {
+
+constexpr uint64_t kMul = 0xc6a4a7935bd1e995;
+constexpr int kShift = 47;
+constexpr uint64_t kSeed = 0x9ae16a3b2f90404f;
+
+// Load 8 bytes in little-endian order, regardless of the host byte order,
+// so that fingerprints are the same on every platform.
+uint64_t Load64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+uint64_t Mix(uint64_t k) {
+    k *= kMul;
+    k ^= k >> kShift;
+    return k * kMul;
+}
+
+uint64_t Finalize(uint64_t h) {
+    h ^= h >> kShift;
+    h *= kMul;
+    h ^= h >> kShift;
+    return h;
+}
+
+}  // namespace
+
+uint64_t Fingerprint(std::string_view s) {
+    const auto* p = reinterpret_cast<const unsigned char*>(s.data());
+    const size_t len = s.size();
+    uint64_t h = kSeed ^ (len * kMul);
+
+    const unsigned char* end = p + (len / 8) * 8;
+    for (; p != end; p += 8) {
+        h ^= Mix(Load64(p));
+        h *= kMul;
+    }
+
+    size_t tail = len & 7;
+    if (tail > 0) {
+        uint64_t k = 0;
+        for (size_t i = tail; i > 0; i--) {
+            k = (k << 8) | p[i - 1];
+        }
+        h ^= k;
+        h *= kMul;
+    }
+    return Finalize(h);
+}
+
+uint64_t FingerprintCombine(uint64_t a, uint64_t b) {
+    return Finalize((a ^ Mix(b)) * kMul);
+}
+
+}  // namespace ashuffle
@@ -0,0 +1,23 @@
+#ifndef __ASHUFFLE_FINGERPRINT_H__
+#define __ASHUFFLE_FINGERPRINT_H__
+
+#include <cstdint>
+#include <string_view>
+
+namespace ashuffle {
+
+// Fingerprint returns a 64-bit hash of the given string. Unlike absl::Hash,
+// which is randomly seeded for every process, fingerprints are stable: the
+// same string always has the same fingerprint, on every run, and on every
+// platform. This makes them suitable as persistent identities for songs.
+//
+// The hash is MurmurHash64A, with a fixed seed.
+uint64_t Fingerprint(std::string_view s);
+
+// Combine two fingerprints into a new one. The result depends on the order
+// of the arguments.
+uint64_t FingerprintCombine(uint64_t a, uint64_t b);
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_FINGERPRINT_H__
@@ -0,0 +1,77 @@
+#include "front_coded.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ashuffle {
+
+namespace {
+
+// Lengths are stored as LEB128-style varints: 7 bits per byte, with the high
+// bit set on every byte but the last.
+void PutVarint(std::string* out, size_t v) {
+    while (v >= 0x80) {
+        out->push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out->push_back(static_cast<char>(v));
+}
+
+size_t GetVarint(const char** p) {
+    size_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char b = static_cast<unsigned char>(*(*p)++);
+        v |= static_cast<size_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+    }
+}
+
+size_t SharedPrefix(std::string_view a, std::string_view b) {
+    size_t max = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < max && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+}  // namespace
+
+FrontCodedDict::FrontCodedDict(const std::vector<std::string_view>& sorted)
+    : size_(sorted.size()) {
+    restarts_.reserve((sorted.size() + kBlockSize - 1) / kBlockSize);
+    std::string_view prev;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        std::string_view cur = sorted[i];
+        assert((i == 0 || prev < cur) && "strings must be sorted and unique");
+        size_t shared = 0;
+        if (i % kBlockSize == 0) {
+            assert(data_.size() <= UINT32_MAX && "dictionary too large");
+            restarts_.push_back(static_cast<uint32_t>(data_.size()));
+        } else {
+            shared = SharedPrefix(prev, cur);
+            PutVarint(&data_, shared);
+        }
+        PutVarint(&data_, cur.size() - shared);
+        data_.append(cur.substr(shared));
+        prev = cur;
+    }
+    data_.shrink_to_fit();
+}
+
+void FrontCodedDict::Get(uint32_t id, std::string* out) const {
+    assert(id < size_ && "id out of range");
+    const char* p = data_.data() + restarts_[id / kBlockSize];
+    out->clear();
+    for (size_t i = 0; i <= id % kBlockSize; i++) {
+        size_t shared = i == 0 ? 0 : GetVarint(&p);
+        size_t suffix = GetVarint(&p);
+        out->resize(shared);
+        out->append(p, suffix);
+        p += suffix;
+    }
+}
+
+}  // namespace ashuffle
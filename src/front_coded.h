@@ -0,0 +1,53 @@
+#ifndef __ASHUFFLE_FRONT_CODED_H__
+#define __ASHUFFLE_FRONT_CODED_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ashuffle {
+
+// FrontCodedDict is an immutable, compressed, dictionary of strings. Strings
+// are stored in sorted order and identified by their index in that order.
+//
+// Strings are grouped in blocks of kBlockSize. The first string in a block
+// (the "restart point") is stored in full, and every other string is stored
+// as the length of the prefix it shares with the previous string, followed by
+// the rest of the string. Since song URIs share long directory prefixes, this
+// usually stores URIs in a fraction of their uncompressed size. Looking up a
+// string only needs to decode at most one block.
+class FrontCodedDict {
+   public:
+    static constexpr size_t kBlockSize = 16;
+
+    FrontCodedDict() = default;
+
+    // Build a dictionary from the given strings. `sorted` must be sorted,
+    // and must not contain duplicates.
+    explicit FrontCodedDict(const std::vector<std::string_view>& sorted);
+
+    // Returns the number of strings in this dictionary.
+    size_t Size() const { return size_; }
+
+    // Decode the string with the given id into `out`. `out` is overwritten,
+    // but its storage is re-used, so repeated lookups into the same string
+    // do not need to allocate.
+    void Get(uint32_t id, std::string* out) const;
+
+    // Returns the number of bytes used by the encoded dictionary.
+    size_t Bytes() const {
+        return data_.capacity() + restarts_.capacity() * sizeof(uint32_t);
+    }
+
+   private:
+    std::string data_;
+    // Offset into `data_` of the restart point of each block.
+    std::vector<uint32_t> restarts_;
+    size_t size_ = 0;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_FRONT_CODED_H__
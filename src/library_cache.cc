@@ -0,0 +1,162 @@
+#include "library_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#include <absl/strings/str_format.h>
+
+#include "binary_file.h"
+#include "fingerprint.h"
+
+namespace ashuffle {
+
+namespace {
+
+// Cache files start with this magic, followed by the format version, the
+// key, and the number of items. Each item is its key, the number of its
+// URIs and tags, and then its URIs and tags, each prefixed by its length.
+// The file ends with a checksum of the header and the items. All integers
+// are little-endian.
+constexpr std::string_view kCacheMagic = "ASHL";
+constexpr uint32_t kCacheVersion = 1;
+constexpr size_t kHeaderSize = kCacheMagic.size() + 4 + 8 + 8;
+
+// Read the next item from `reader` into `entry`, or only skip over it, if
+// `entry` is null.
+void ReadEntry(BinaryReader* reader, LibraryCache::Entry* entry) {
+    uint64_t key = reader->Get<uint64_t>();
+    uint32_t uris = reader->Get<uint32_t>();
+    uint32_t tags = reader->Get<uint32_t>();
+    if (entry != nullptr) {
+        entry->key = key;
+        entry->uris.resize(uris);
+        entry->tags.resize(tags);
+    }
+    for (uint32_t i = 0; i < uris + tags && reader->ok; i++) {
+        std::string_view s = reader->GetString();
+        if (entry == nullptr) {
+            continue;
+        }
+        (i < uris ? entry->uris[i] : entry->tags[i - uris]) = s;
+    }
+}
+
+// Returns the checksum of a cache file with the given header and items.
+uint64_t Checksum(std::string_view header, std::string_view items) {
+    return FingerprintCombine(Fingerprint(header), Fingerprint(items));
+}
+
+}  // namespace
+
+std::variant<bool, std::string> LibraryCache::Load(
+    uint64_t key, const std::function<void(const Entry&)>& add) {
+    int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        return false;
+    }
+    if (fd < 0) {
+        return ErrnoMessage("failed to open library cache", path_);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::string err = ErrnoMessage("failed to read library cache", path_);
+        close(fd);
+        return err;
+    }
+    // The whole file is read at once, into a buffer of its size, which is
+    // left uninitialized until then.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    size_t size = static_cast<size_t>(st.st_size);
+    std::unique_ptr<char[]> buf(new char[size]);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buf.get() + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            std::string err =
+                ErrnoMessage("failed to read library cache", path_);
+            close(fd);
+            return err;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    close(fd);
+
+    std::string_view view(buf.get(), done);
+    if (view.size() < kHeaderSize + sizeof(uint64_t) ||
+        view.substr(0, kCacheMagic.size()) != kCacheMagic) {
+        return absl::StrFormat("'%s' is not a library cache", path_);
+    }
+    BinaryReader reader{view.substr(kCacheMagic.size())};
+    // Caches in another format, or made with another key, are misses, and
+    // are replaced by the next Save.
+    if (reader.Get<uint32_t>() != kCacheVersion ||
+        reader.Get<uint64_t>() != key) {
+        return false;
+    }
+    uint64_t count = reader.Get<uint64_t>();
+
+    std::string_view header = view.substr(0, kHeaderSize);
+    std::string_view items = view.substr(
+        kHeaderSize, view.size() - kHeaderSize - sizeof(uint64_t));
+    BinaryReader trailer{view.substr(kHeaderSize + items.size())};
+    if (trailer.Get<uint64_t>() != Checksum(header, items)) {
+        return absl::StrFormat("library cache '%s' is corrupt", path_);
+    }
+
+    reader = BinaryReader{items};
+    for (uint64_t i = 0; i < count && reader.ok; i++) {
+        ReadEntry(&reader, nullptr);
+    }
+    if (!reader.ok || !reader.data.empty()) {
+        return absl::StrFormat("library cache '%s' has the wrong size", path_);
+    }
+
+    reader = BinaryReader{items};
+    Entry entry;
+    for (uint64_t i = 0; i < count; i++) {
+        ReadEntry(&reader, &entry);
+        add(entry);
+    }
+    return true;
+}
+
+void LibraryCache::Record(uint64_t key, absl::Span<const std::string> uris,
+                          absl::Span<const std::string> tags) {
+    PutInt<uint64_t>(&recorded_, key);
+    PutInt<uint32_t>(&recorded_, uris.size());
+    PutInt<uint32_t>(&recorded_, tags.size());
+    for (const std::string& uri : uris) {
+        PutString(&recorded_, uri);
+    }
+    for (const std::string& tag : tags) {
+        PutString(&recorded_, tag);
+    }
+    count_++;
+}
+
+std::optional<std::string> LibraryCache::Save(uint64_t key) {
+    std::string header(kCacheMagic);
+    PutInt<uint32_t>(&header, kCacheVersion);
+    PutInt<uint64_t>(&header, key);
+    PutInt<uint64_t>(&header, count_);
+    std::string trailer;
+    PutInt<uint64_t>(&trailer, Checksum(header, recorded_));
+    std::string items = std::exchange(recorded_, std::string());
+    count_ = 0;
+
+    return WriteFileAtomic(path_, "library cache", {header, items, trailer});
+}
+
+}  // namespace ashuffle
@@ -0,0 +1,62 @@
+#ifndef __ASHUFFLE_LIBRARY_CACHE_H__
+#define __ASHUFFLE_LIBRARY_CACHE_H__
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include <absl/types/span.h>
+
+namespace ashuffle {
+
+// LibraryCache persists the items loaded from MPD (after the ruleset, and
+// grouping, are applied) to a file, so that a later load with the same key
+// can read them back in one sequential read, rather than listing every song
+// in MPD again. The key identifies everything the items depend on (see
+// MPDLoader::SetCache): a cache made with any other key is ignored.
+class LibraryCache {
+   public:
+    explicit LibraryCache(std::string path) : path_(std::move(path)){};
+
+    // An Entry is a single cached item: its key, its URIs, and its tags (see
+    // ShuffleItem). The URIs and tags point into the cache's buffer.
+    struct Entry {
+        uint64_t key = 0;
+        std::vector<std::string_view> uris;
+        std::vector<std::string_view> tags;
+    };
+
+    // Load the cache, if it was saved with the given key, calling `add` with
+    // every cached item, in the order they were recorded. The entry passed
+    // to `add` is only valid for the duration of the call. Returns true if
+    // the cache was loaded, or false if there is no cache for this key
+    // (e.g., the file is missing, or was made with another key). Returns an
+    // error message if the file could not be read, or is corrupt. The whole
+    // file is checked before any item is added, so `add` is only called on
+    // success.
+    std::variant<bool, std::string> Load(
+        uint64_t key, const std::function<void(const Entry&)>& add);
+
+    // Record an item, to be saved by the next call to Save.
+    void Record(uint64_t key, absl::Span<const std::string> uris,
+                absl::Span<const std::string> tags);
+
+    // Save the recorded items under the given key, and clear them. Like a
+    // StateFile, the file is replaced atomically. Returns an error message
+    // on failure.
+    std::optional<std::string> Save(uint64_t key);
+
+   private:
+    std::string path_;
+    // The encoded items recorded since the last Save, and their count.
+    std::string recorded_;
+    uint64_t count_ = 0;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_LIBRARY_CACHE_H__
@@ -1,54 +1,556 @@
 #include "load.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
-#include <unordered_map>
+#include <iterator>
+#include <mutex>
+#include <type_traits>
 #include <vector>
 
-#include <absl/hash/hash.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 
+#include "fingerprint.h"
+
 namespace ashuffle {
 
 namespace {
 
-// A Group is a vector of field values, present or not.
-typedef std::vector<std::optional<std::string>> Group;
+// Returns a stable key for the group of `song`, which is the song's values
+// of the `group_by` fields, present or not. The key is the group's
+// identity: while loading, songs with the same key are in the same group,
+// and the group keeps the key in the shuffle chain when songs are added
+// to, or removed from, it. Values are read in place, and only their
+// fingerprints are kept, so no memory is allocated per song.
+uint64_t GroupKey(const mpd::Song &song,
+                  const std::vector<enum mpd_tag_type> &group_by) {
+    uint64_t key = group_by.size();
+    for (enum mpd_tag_type field : group_by) {
+        std::optional<std::string_view> value = song.TagView(field);
+        // Missing fields are distinct from empty ones.
+        key = FingerprintCombine(key, value ? Fingerprint(*value) : 0);
+        key = FingerprintCombine(key, value.has_value());
+    }
+    return key;
+}
+
+// Append the values of the given tags of `song` to `tags`, skipping values
+// that are already in `tags`. Values are prefixed with their tag type, so
+// that, e.g., an artist and an album with the same name are distinct.
+void AppendTags(const mpd::Song &song,
+                const std::vector<enum mpd_tag_type> &fields,
+                std::vector<std::string> *tags) {
+    for (enum mpd_tag_type field : fields) {
+        std::optional<std::string> value = song.Tag(field);
+        if (!value) {
+            continue;
+        }
+        std::string tag = absl::StrCat(static_cast<int>(field), ":", *value);
+        if (std::find(tags->begin(), tags->end(), tag) == tags->end()) {
+            tags->push_back(std::move(tag));
+        }
+    }
+}
+
+// Add `uri`, whose fingerprint is `key`, to `into`.
+template <typename Sink>
+void AddURI(Sink *into, std::string_view uri, uint64_t key) {
+    into->Add(ShuffleItem(uri, key));
+}
+
+void AddURI(Reservoir *into, std::string_view uri, uint64_t) {
+    into->Add(uri);
+}
+
+// CachedItemAdder adds the items read from a LibraryCache to a sink.
+template <typename Sink>
+struct CachedItemAdder {
+    Sink *into;
+    bool grouped;
+    // Single URIs are added straight from the cache's buffer. ShuffleItem
+    // refers to groups, and tags, as vectors of strings, so they are copied
+    // into these, which are re-used for every item.
+    std::vector<std::string> uris;
+    std::vector<std::string> tags;
+
+    void operator()(const LibraryCache::Entry &entry) {
+        tags.assign(entry.tags.begin(), entry.tags.end());
+        if (entry.uris.size() == 1) {
+            into->Add(ShuffleItem(entry.uris[0], entry.key).WithTags(tags));
+            return;
+        }
+        uris.assign(entry.uris.begin(), entry.uris.end());
+        into->Add(ShuffleItem(uris, entry.key).WithTags(tags));
+    }
+};
+
+template <>
+void CachedItemAdder<Reservoir>::operator()(const LibraryCache::Entry &entry) {
+    for (std::string_view uri : entry.uris) {
+        if (grouped) {
+            into->AddToGroup(entry.key, uri);
+        } else {
+            into->Add(uri);
+        }
+    }
+}
+
+// Print a warning if `file` could not be read to its end.
+void WarnIfIncomplete(const URIFile &file) {
+    if (file.Error()) {
+        std::cerr << "warning: could not read the whole URI file: "
+                  << *file.Error() << std::endl;
+    }
+}
+
+// Files that list fewer than 1 in kLookupRatio of the songs in MPD are
+// loaded by looking up each listed song. MPD still matches each lookup
+// against its whole database, in memory, so lookups only beat listing
+// (and sending) every song for lists that are small compared to MPD's
+// database.
+constexpr size_t kLookupRatio = 64;
+
+// SongListReader reads songs from a list of songs that were already
+// fetched.
+class SongListReader : public mpd::SongReader {
+   public:
+    SongListReader(std::vector<std::unique_ptr<mpd::Song>> songs)
+        : songs_(std::move(songs)){};
+
+    std::optional<std::unique_ptr<mpd::Song>> Next() override {
+        if (Done()) {
+            return std::nullopt;
+        }
+        return std::move(songs_[next_++]);
+    }
+
+    bool Done() override { return next_ >= songs_.size(); }
+
+   private:
+    std::vector<std::unique_ptr<mpd::Song>> songs_;
+    size_t next_ = 0;
+};
+
+// The most songs fetched one by one on an incremental reload. Songs added
+// to MPD with an old modification time (e.g., copied with their times
+// preserved) are not listed as modified, and have to be fetched by URI.
+// Past this many, a full reload is cheaper.
+constexpr size_t kMaxReloadSearches = 256;
+
+// The number of songs read from MPD before they are handed to a worker.
+constexpr size_t kVerifyBatchSize = 1024;
+
+// A VerifyBatch is a run of songs read from MPD, to be verified by a
+// worker. Once `done` is set, `songs` is empty and `loaded` holds the songs
+// that passed verification, in order.
+template <typename T>
+struct VerifyBatch {
+    std::vector<std::unique_ptr<mpd::Song>> songs;
+    std::vector<T> loaded;
+    bool done = false;
+};
+
+// VerifyPool runs `prepare` over batches of songs on a set of worker
+// threads. Batches are verified in any order, so the caller must wait on
+// each batch, in turn, to keep the songs in order.
+template <typename T>
+class VerifyPool {
+   public:
+    typedef std::function<std::optional<T>(const mpd::Song &)> Prepare;
+
+    VerifyPool(unsigned threads, Prepare prepare)
+        : prepare_(std::move(prepare)) {
+        for (unsigned i = 0; i < threads; i++) {
+            workers_.emplace_back([this] { Work(); });
+        }
+    }
+
+    ~VerifyPool() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        queued_.notify_all();
+        for (std::thread &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void Submit(VerifyBatch<T> *batch) {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            queue_.push_back(batch);
+        }
+        queued_.notify_one();
+    }
+
+    // Returns true if `batch` is done. If `block` is true, this waits for
+    // the batch to be done.
+    bool Done(VerifyBatch<T> *batch, bool block) {
+        std::unique_lock<std::mutex> lock(mu_);
+        if (block) {
+            finished_.wait(lock, [batch] { return batch->done; });
+        }
+        return batch->done;
+    }
+
+   private:
+    void Work() {
+        std::unique_lock<std::mutex> lock(mu_);
+        while (true) {
+            queued_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            VerifyBatch<T> *batch = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
 
-// A GroupMap is a mapping from Groups to song URI vectors of the URIs in the
-// given group.
-typedef std::unordered_map<Group, std::vector<std::string>, absl::Hash<Group>>
-    GroupMap;
+            for (const std::unique_ptr<mpd::Song> &song : batch->songs) {
+                if (std::optional<T> loaded = prepare_(*song)) {
+                    batch->loaded.push_back(std::move(*loaded));
+                }
+            }
+            batch->songs.clear();
+
+            lock.lock();
+            batch->done = true;
+            // Only the reading thread waits on finished batches.
+            finished_.notify_one();
+        }
+    }
+
+    Prepare prepare_;
+    std::mutex mu_;
+    std::condition_variable queued_;
+    std::condition_variable finished_;
+    std::deque<VerifyBatch<T> *> queue_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
 
 }  // namespace
 
-/* build the list of songs to shuffle from using MPD */
-void MPDLoader::Load(ShuffleChain *songs) {
-    GroupMap groups;
+std::vector<enum mpd_tag_type> MPDLoader::ListTags() const {
+    std::vector<enum mpd_tag_type> tags(group_by_);
+    tags.insert(tags.end(), spread_by_.begin(), spread_by_.end());
+    for (const Rule &rule : rules_) {
+        rule.AppendTags(&tags);
+    }
+    std::sort(tags.begin(), tags.end());
+    tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+    return tags;
+}
+
+std::optional<MPDLoader::LoadedSong> MPDLoader::Prepare(
+    const mpd::Song &song) {
+    if (!Verify(song)) {
+        return std::nullopt;
+    }
+    LoadedSong loaded;
+    loaded.uri = song.URI();
+    if (!group_by_.empty()) {
+        loaded.group_key = GroupKey(song, group_by_);
+    }
+    AppendTags(song, spread_by_, &loaded.tags);
+    return loaded;
+}
+
+std::unique_ptr<mpd::SongReader> MPDLoader::ListSongs(
+    const std::vector<mpd::Exclusion> &exclude) {
+    return mpd_->ListAll(ListTags(), exclude);
+}
+
+uint64_t MPDLoader::CacheKey() const {
+    uint64_t key = rules_.size();
+    for (const Rule &rule : rules_) {
+        key = FingerprintCombine(key, rule.Digest());
+    }
+    for (const std::vector<enum mpd_tag_type> *fields :
+         {&group_by_, &spread_by_}) {
+        key = FingerprintCombine(key, fields->size());
+        for (enum mpd_tag_type field : *fields) {
+            key = FingerprintCombine(key, field);
+        }
+    }
+    return key;
+}
+
+std::optional<uint64_t> MPDLoader::CurrentCacheKey() {
+    if (!cache_) {
+        return std::nullopt;
+    }
+    // Any change to MPD's database changes the time of its last update.
+    time_t updated = mpd_->DatabaseUpdated();
+    if (updated == 0) {
+        return std::nullopt;
+    }
+    return FingerprintCombine(CacheKey(), updated);
+}
+
+template <typename Sink>
+bool MPDLoader::LoadCached(uint64_t key, Sink *into) {
+    CachedItemAdder<Sink> adder{into, !group_by_.empty(), {}, {}};
+    auto loaded = cache_->Load(
+        key, [&adder](const LibraryCache::Entry &entry) { adder(entry); });
+    if (std::string *err = std::get_if<std::string>(&loaded);
+        err != nullptr) {
+        std::cerr << "warning: " << *err << std::endl;
+        return false;
+    }
+    return std::get<bool>(loaded);
+}
+
+template <typename F>
+void MPDLoader::ForEachSong(F &&f) {
+    // Excluded songs are left out by MPD, where it can, but every song is
+    // still verified, since MPD may list songs that rules do not accept.
+    std::vector<mpd::Exclusion> exclude;
+    for (const Rule &rule : rules_) {
+        rule.AppendExclusions(&exclude);
+    }
+    std::unique_ptr<mpd::SongReader> reader = ListSongs(exclude);
+    if (threads_ <= 1) {
+        while (!reader->Done()) {
+            std::unique_ptr<mpd::Song> song = *reader->Next();
+            if (std::optional<LoadedSong> loaded = Prepare(*song)) {
+                f(std::move(*loaded));
+            }
+        }
+        return;
+    }
+
+    // This thread reads songs from MPD, and merges verified batches back
+    // in the order they were read. Bounding the batches in flight bounds
+    // the songs held in memory when MPD is faster than the workers.
+    const size_t max_in_flight = 2 * threads_;
+    std::deque<std::unique_ptr<VerifyBatch<LoadedSong>>> in_flight;
+    VerifyPool<LoadedSong> pool(
+        threads_, [this](const mpd::Song &song) { return Prepare(song); });
+
+    // Merge the oldest batch, if it is done (or once it is, if `block`).
+    // Returns true if a batch was merged.
+    auto merge = [&](bool block) {
+        if (in_flight.empty() || !pool.Done(in_flight.front().get(), block)) {
+            return false;
+        }
+        for (LoadedSong &loaded : in_flight.front()->loaded) {
+            f(std::move(loaded));
+        }
+        in_flight.pop_front();
+        return true;
+    };
 
-    std::unique_ptr<mpd::SongReader> reader = mpd_->ListAll();
     while (!reader->Done()) {
-        std::unique_ptr<mpd::Song> song = *reader->Next();
-        if (!Verify(*song)) {
-            continue;
+        auto batch = std::make_unique<VerifyBatch<LoadedSong>>();
+        while (batch->songs.size() < kVerifyBatchSize && !reader->Done()) {
+            batch->songs.push_back(*reader->Next());
+        }
+        pool.Submit(batch.get());
+        in_flight.push_back(std::move(batch));
+        while (merge(in_flight.size() >= max_in_flight)) {
         }
+    }
+    while (merge(true)) {
+    }
+}
 
-        if (group_by_.empty()) {
-            songs->Add(song->URI());
-            continue;
+void MPDLoader::Load(ShuffleChain *songs) { LoadInto(songs); }
+
+void MPDLoader::Stream(ShuffleFeed *songs) {
+    LoadInto(songs);
+    songs->Close();
+}
+
+/* build the list of songs to shuffle from using MPD */
+template <typename Sink>
+void MPDLoader::LoadInto(Sink *songs) {
+    std::optional<uint64_t> cache_key = CurrentCacheKey();
+    if (cache_key && LoadCached(*cache_key, songs)) {
+        return;
+    }
+    // Songs are recorded as they are added, and the cache is saved once
+    // they are all loaded.
+    auto save_cache = [&] {
+        if (!cache_key) {
+            return;
         }
-        Group group;
-        for (auto &field : group_by_) {
-            group.emplace_back(song->Tag(field));
+        if (std::optional<std::string> err = cache_->Save(*cache_key); err) {
+            std::cerr << "warning: " << *err << std::endl;
         }
-        groups[group].push_back(song->URI());
+    };
+
+    // Groups are indexed by key, and kept in the order they were first
+    // seen, so that a seeded shuffle chain picks the same groups on every
+    // run.
+    internal::KeyIndex group_index;
+    std::vector<std::vector<std::string>> groups;
+    std::vector<uint64_t> group_keys;
+    std::vector<std::vector<std::string>> group_tags;
+    if (!group_by_.empty()) {
+        groups.reserve(group_count_);
+        group_keys.reserve(group_count_);
+        group_tags.reserve(group_count_);
     }
 
+    ForEachSong([&](LoadedSong &&song) {
+        if (group_by_.empty()) {
+            uint64_t key = Fingerprint(song.uri);
+            songs->Add(ShuffleItem(song.uri, key).WithTags(song.tags));
+            if (cache_key) {
+                cache_->Record(key, absl::MakeConstSpan(&song.uri, 1),
+                               song.tags);
+            }
+            return;
+        }
+        uint32_t group = group_index.Find(song.group_key, group_keys);
+        if (group == internal::KeyIndex::kNotFound) {
+            group = groups.size();
+            groups.emplace_back();
+            group_keys.push_back(song.group_key);
+            group_tags.emplace_back();
+            group_index.Insert(group, group_keys);
+        }
+        groups[group].emplace_back(std::move(song.uri));
+        std::vector<std::string> &tags = group_tags[group];
+        for (std::string &tag : song.tags) {
+            if (std::find(tags.begin(), tags.end(), tag) == tags.end()) {
+                tags.push_back(std::move(tag));
+            }
+        }
+    });
+
     if (group_by_.empty()) {
+        save_cache();
+        return;
+    }
+
+    group_count_ = groups.size();
+    for (size_t i = 0; i < groups.size(); i++) {
+        songs->Add(
+            ShuffleItem(groups[i], group_keys[i]).WithTags(group_tags[i]));
+        if (cache_key) {
+            cache_->Record(group_keys[i], groups[i], group_tags[i]);
+        }
+    }
+    save_cache();
+}
+
+void MPDLoader::Sample(Reservoir *into) {
+    if (std::optional<uint64_t> cache_key = CurrentCacheKey();
+        cache_key && LoadCached(*cache_key, into)) {
+        return;
+    }
+    ForEachSong([&](LoadedSong &&song) {
+        if (group_by_.empty()) {
+            into->Add(song.uri);
+            return;
+        }
+        // Only the group's key is needed, so groups are never built.
+        into->AddToGroup(song.group_key, song.uri);
+    });
+}
+
+void Loader::Reload(ShuffleChain *songs) {
+    songs->BeginReload();
+    Load(songs);
+    songs->EndReload();
+}
+
+void MPDLoader::Reload(ShuffleChain *songs) {
+    // Read the update time first, so that changes made by an update that
+    // finishes while reloading are listed by the next reload.
+    time_t updated = mpd_->DatabaseUpdated();
+    if (!group_by_.empty() || updated == 0) {
+        // Groups can change without any of their songs changing (e.g.,
+        // when a song moves to another group), so they are always rebuilt.
+        synced_ = 0;
+        Loader::Reload(songs);
         return;
     }
+    if (synced_ != 0 && ReloadChanged(songs)) {
+        since_ = synced_;
+    } else {
+        // URIs are listed before loading, so songs added during the load
+        // are picked up by the next reload.
+        known_ = ListKnown();
+        Loader::Reload(songs);
+        since_ = updated;
+    }
+    synced_ = updated;
+}
+
+std::vector<uint64_t> MPDLoader::ListKnown() {
+    std::vector<uint64_t> known;
+    mpd_->ListURIs(
+        [&known](std::string_view uri) { known.push_back(Fingerprint(uri)); });
+    std::sort(known.begin(), known.end());
+    return known;
+}
+
+bool MPDLoader::ReloadChanged(ShuffleChain *songs) {
+    std::vector<uint64_t> known;
+    std::vector<std::string> added;
+    mpd_->ListURIs([&](std::string_view uri) {
+        uint64_t key = Fingerprint(uri);
+        known.push_back(key);
+        if (!std::binary_search(known_.begin(), known_.end(), key)) {
+            added.emplace_back(uri);
+        }
+    });
+    std::sort(known.begin(), known.end());
+
+    std::unique_ptr<mpd::SongReader> reader =
+        mpd_->ListModifiedSince(since_, ListTags());
+    if (reader == nullptr) {
+        return false;
+    }
 
-    for (auto &&[_, group] : groups) {
-        songs->Add(group);
+    std::vector<uint64_t> removed;
+    std::set_difference(known_.begin(), known_.end(), known.begin(),
+                        known.end(), std::back_inserter(removed));
+    for (uint64_t key : removed) {
+        songs->Remove(key);
+    }
+
+    // Modified songs include most added songs, so those need not be
+    // fetched again.
+    std::sort(added.begin(), added.end());
+    std::vector<bool> fetched(added.size());
+    while (!reader->Done()) {
+        std::unique_ptr<mpd::Song> song = *reader->Next();
+        auto it = std::lower_bound(added.begin(), added.end(), song->URI());
+        if (it != added.end() && *it == song->URI()) {
+            fetched[it - added.begin()] = true;
+        }
+        Update(songs, *song);
+    }
+
+    size_t searches = std::count(fetched.begin(), fetched.end(), false);
+    if (searches > kMaxReloadSearches) {
+        return false;
+    }
+    for (size_t i = 0; i < added.size(); i++) {
+        if (fetched[i]) {
+            continue;
+        }
+        if (std::optional<std::unique_ptr<mpd::Song>> song =
+                mpd_->Search(added[i])) {
+            Update(songs, **song);
+        }
+    }
+    known_ = std::move(known);
+    return true;
+}
+
+void MPDLoader::Update(ShuffleChain *songs, const mpd::Song &song) {
+    if (std::optional<LoadedSong> loaded = Prepare(song)) {
+        songs->Add(ShuffleItem(loaded->uri).WithTags(loaded->tags));
+    } else {
+        songs->Remove(song.URI());
     }
 }
 
@@ -63,19 +565,17 @@ bool MPDLoader::Verify(const mpd::Song &song) {
 
 FileMPDLoader::FileMPDLoader(mpd::MPD *mpd, const std::vector<Rule> &ruleset,
                              const std::vector<enum mpd_tag_type> &group_by,
-                             std::istream *file)
-    : MPDLoader(mpd, ruleset, group_by), file_(file) {
-    for (std::string uri; std::getline(*file_, uri);) {
-        valid_uris_.emplace_back(uri);
-    }
-    std::sort(valid_uris_.begin(), valid_uris_.end());
+                             const std::vector<enum mpd_tag_type> &spread_by,
+                             URIFile file)
+    : MPDLoader(mpd, ruleset, group_by, spread_by), file_(std::move(file)) {
+    WarnIfIncomplete(file_);
+    file_.Dedupe();
 }
 
 bool FileMPDLoader::Verify(const mpd::Song &song) {
-    if (!std::binary_search(valid_uris_.begin(), valid_uris_.end(),
-                            song.URI())) {
-        // If the URI for this song is not in the list of valid_uris_, then
-        // it shouldn't be loaded by this loader.
+    if (!file_.Contains(song.URI())) {
+        // If the URI for this song is not in the file, then it shouldn't be
+        // loaded by this loader.
         return false;
     }
 
@@ -83,10 +583,92 @@ bool FileMPDLoader::Verify(const mpd::Song &song) {
     return MPDLoader::Verify(song);
 }
 
-void FileLoader::Load(ShuffleChain *songs) {
-    for (std::string uri; std::getline(*file_, uri);) {
-        songs->Add(uri);
+std::unique_ptr<mpd::SongReader> FileMPDLoader::ListSongs(
+    const std::vector<mpd::Exclusion> &exclude) {
+    if (file_.URIs().size() * kLookupRatio >= mpd_->DatabaseSongs()) {
+        return MPDLoader::ListSongs(exclude);
+    }
+    return std::make_unique<SongListReader>(mpd_->Search(file_.URIs()));
+}
+
+uint64_t FileMPDLoader::CacheKey() const {
+    uint64_t key =
+        FingerprintCombine(MPDLoader::CacheKey(), file_.Keys().size());
+    for (uint64_t uri : file_.Keys()) {
+        key = FingerprintCombine(key, uri);
+    }
+    return key;
+}
+
+void FileLoader::Load(ShuffleChain *songs) { LoadInto(songs); }
+
+void FileLoader::Stream(ShuffleFeed *songs) {
+    LoadInto(songs);
+    songs->Close();
+}
+
+void FileLoader::Sample(Reservoir *into) { LoadInto(into); }
+
+template <typename Sink>
+void FileLoader::LoadInto(Sink *songs) {
+    // URIs listed more than once are only kept once by the chain, so the
+    // file is only deduped for the reservoir, which keeps every URI it is
+    // given.
+    URIFile file = path_.empty() ? URIFile::Read(file_) : URIFile::Open(path_);
+    WarnIfIncomplete(file);
+    if constexpr (std::is_same_v<Sink, Reservoir>) {
+        file.Dedupe();
+    }
+    for (size_t i = 0; i < file.URIs().size(); i++) {
+        AddURI(songs, file.URIs()[i], file.Keys()[i]);
+    }
+}
+
+BackgroundLoad::BackgroundLoad(std::unique_ptr<mpd::MPD> mpd,
+                               std::unique_ptr<Loader> loader,
+                               ShuffleChain *chain)
+    : mpd_(std::move(mpd)),
+      loader_(std::move(loader)),
+      chain_(chain),
+      feed_(chain) {
+    thread_ = std::thread([this] { loader_->Stream(&feed_); });
+}
+
+BackgroundLoad::~BackgroundLoad() {
+    if (thread_.joinable()) {
+        thread_.join();
     }
 }
 
+void BackgroundLoad::WaitForStart(size_t count,
+                                  std::chrono::milliseconds budget) {
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    while (!Drain()) {
+        size_t len = chain_->Len();
+        if (len >= count ||
+            (len > 0 && std::chrono::steady_clock::now() >= deadline)) {
+            return;
+        }
+        if (len > 0) {
+            feed_.WaitUntil(deadline);
+        } else {
+            feed_.Wait();
+        }
+    }
+}
+
+bool BackgroundLoad::Drain() {
+    if (!thread_.joinable()) {
+        return true;
+    }
+    feed_.Drain();
+    if (!feed_.Done()) {
+        return false;
+    }
+    thread_.join();
+    loader_.reset();
+    mpd_.reset();
+    return true;
+}
+
 }  // namespace ashuffle
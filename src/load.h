@@ -1,16 +1,25 @@
 #ifndef __ASHUFFLE_LOAD_H__
 #define __ASHUFFLE_LOAD_H__
 
+#include <chrono>
+#include <ctime>
 #include <istream>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #include <mpd/tag.h>
 
+#include "library_cache.h"
 #include "mpd.h"
+#include "reservoir.h"
 #include "rule.h"
 #include "shuffle.h"
+#include "shuffle_feed.h"
+#include "uri_file.h"
 #include "util.h"
 
 namespace ashuffle {
@@ -21,6 +30,16 @@ class Loader {
    public:
     virtual ~Loader(){};
     virtual void Load(ShuffleChain* into) = 0;
+    // Stream loads songs into the given feed, as the producer, and closes
+    // the feed once all songs are loaded.
+    virtual void Stream(ShuffleFeed* into) = 0;
+    // Sample reads every song (or group), but only keeps a random sample
+    // of them, in the given reservoir.
+    virtual void Sample(Reservoir* into) = 0;
+    // Reload brings a chain that was loaded by this loader up to date, after
+    // the library changed. By default, every song is loaded again, between
+    // ShuffleChain::BeginReload and EndReload.
+    virtual void Reload(ShuffleChain* into);
 };
 
 class MPDLoader : public Loader {
@@ -30,17 +49,123 @@ class MPDLoader : public Loader {
         : MPDLoader(mpd, ruleset, std::vector<enum mpd_tag_type>()){};
     MPDLoader(mpd::MPD* mpd, const std::vector<Rule>& ruleset,
               const std::vector<enum mpd_tag_type>& group_by)
-        : mpd_(mpd), rules_(ruleset), group_by_(group_by){};
+        : MPDLoader(mpd, ruleset, group_by,
+                    std::vector<enum mpd_tag_type>()){};
+    // Songs (or groups) are tagged with the values of the `spread_by` tags,
+    // for use with ShuffleChain::SetTagCooldown. Groups get the values of
+    // all of their songs.
+    MPDLoader(mpd::MPD* mpd, const std::vector<Rule>& ruleset,
+              const std::vector<enum mpd_tag_type>& group_by,
+              const std::vector<enum mpd_tag_type>& spread_by)
+        : mpd_(mpd),
+          rules_(ruleset),
+          group_by_(group_by),
+          spread_by_(spread_by){};
 
     void Load(ShuffleChain* into) override;
+    // Songs are streamed as they are read. With `group_by`, groups are
+    // only complete once all songs are read, so they are streamed at the
+    // end.
+    void Stream(ShuffleFeed* into) override;
+    void Sample(Reservoir* into) override;
+    // The first reload loads every song again, and remembers the URIs of
+    // all songs in MPD. Later reloads only fetch the songs that changed
+    // since, and remove the songs that are gone, so they take time in
+    // proportion to the changes, plus a (tagless) listing of all URIs.
+    // With `group_by`, every reload loads every song again.
+    void Reload(ShuffleChain* into) override;
+
+    // Verify songs against the ruleset on `threads` worker threads, while
+    // the calling thread reads songs from MPD. Songs are still loaded in
+    // the order MPD lists them. 0 or 1 verifies songs on the calling
+    // thread.
+    void SetVerifyThreads(unsigned threads) { threads_ = threads; }
+
+    // Cache loaded songs in `cache`. Loads (and samples) read the songs
+    // from the cache, without listing songs in MPD, as long as MPD's
+    // database has not been updated since the cache was saved, and the
+    // ruleset, `group_by`, and `spread_by` are unchanged. Otherwise, songs
+    // are loaded from MPD as usual, and the cache is saved again. Samples
+    // never save the cache. Songs are never cached when MPD does not know
+    // the time of its last update.
+    void SetCache(LibraryCache cache) { cache_ = std::move(cache); }
 
    protected:
+    // Verify may be called from several threads at once. Songs only carry
+    // the tags the rules, `group_by`, and `spread_by` use.
     virtual bool Verify(const mpd::Song&);
 
-   private:
+    // Returns a reader over the songs to verify and load. By default, every
+    // song in MPD is listed, with only the tags in use, leaving out the
+    // excluded songs where MPD can.
+    virtual std::unique_ptr<mpd::SongReader> ListSongs(
+        const std::vector<mpd::Exclusion>& exclude);
+
+    // Returns a key for all of the settings, other than MPD's database,
+    // that decide which songs are loaded, and how.
+    virtual uint64_t CacheKey() const;
+
     mpd::MPD* mpd_;
+
+   private:
+    // A LoadedSong is a song that passed verification, along with the
+    // fields that are needed to load it.
+    struct LoadedSong {
+        std::string uri;
+        uint64_t group_key = 0;
+        std::vector<std::string> tags;
+    };
+
+    // Returns the tags needed to verify, group, and tag songs, so that
+    // MPD can leave every other tag out of the song list.
+    std::vector<enum mpd_tag_type> ListTags() const;
+
+    // Returns the song's fields, or an empty option if it was rejected.
+    std::optional<LoadedSong> Prepare(const mpd::Song&);
+
+    // Call `f` with every song that passes verification, in list order.
+    template <typename F>
+    void ForEachSong(F&& f);
+
+    template <typename Sink>
+    void LoadInto(Sink* into);
+
+    // Returns the key of the cache for the current state of MPD's
+    // database, or an empty option if songs can not be cached.
+    std::optional<uint64_t> CurrentCacheKey();
+
+    // Load the songs cached under `key` into `into`. Returns false if they
+    // are not cached.
+    template <typename Sink>
+    bool LoadCached(uint64_t key, Sink* into);
+
+    // Returns the sorted fingerprints of the URIs of every song in MPD.
+    std::vector<uint64_t> ListKnown();
+
+    // Apply the changes since the last reload to `into`. Returns false if
+    // the changes could not be listed, or there were too many of them, in
+    // which case `into` must be fully reloaded.
+    bool ReloadChanged(ShuffleChain* into);
+
+    // Add (or update) `song` in `into`, or remove it if it is rejected.
+    void Update(ShuffleChain* into, const mpd::Song& song);
+
     const std::vector<Rule>& rules_;
     const std::vector<enum mpd_tag_type> group_by_;
+    const std::vector<enum mpd_tag_type> spread_by_;
+    unsigned threads_ = 1;
+    std::optional<LibraryCache> cache_;
+    // The number of groups found by the last load, to size the next one.
+    size_t group_count_ = 0;
+    // The state of the last reload: the fingerprints of every URI in MPD,
+    // the time of MPD's last update, and of the update before it. Songs
+    // modified during an update's scan may only be listed as modified by
+    // the next update, with a modification time from before it, so
+    // changes are listed from the update before last. Unset while
+    // `synced_` is 0.
+    std::vector<uint64_t> known_;
+    time_t synced_ = 0;
+    time_t since_ = 0;
 };
 
 class FileMPDLoader : public MPDLoader {
@@ -48,25 +173,88 @@ class FileMPDLoader : public MPDLoader {
     ~FileMPDLoader() override = default;
     FileMPDLoader(mpd::MPD* mpd, const std::vector<Rule>& ruleset,
                   const std::vector<enum mpd_tag_type>& group_by,
-                  std::istream* file);
+                  std::istream* file)
+        : FileMPDLoader(mpd, ruleset, group_by,
+                        std::vector<enum mpd_tag_type>(), file){};
+    FileMPDLoader(mpd::MPD* mpd, const std::vector<Rule>& ruleset,
+                  const std::vector<enum mpd_tag_type>& group_by,
+                  const std::vector<enum mpd_tag_type>& spread_by,
+                  std::istream* file)
+        : FileMPDLoader(mpd, ruleset, group_by, spread_by,
+                        URIFile::Read(file)){};
+    FileMPDLoader(mpd::MPD* mpd, const std::vector<Rule>& ruleset,
+                  const std::vector<enum mpd_tag_type>& group_by,
+                  const std::vector<enum mpd_tag_type>& spread_by,
+                  URIFile file);
 
    protected:
     bool Verify(const mpd::Song&) override;
+    // When the file lists few songs compared to MPD's database, only the
+    // listed songs are looked up, rather than listing every song in MPD.
+    // Looked up songs are loaded in file order, rather than in MPD's order.
+    std::unique_ptr<mpd::SongReader> ListSongs(
+        const std::vector<mpd::Exclusion>& exclude) override;
+    // Songs also depend on the URIs in the file, and their order.
+    uint64_t CacheKey() const override;
 
    private:
-    std::istream* file_;
-    std::vector<std::string> valid_uris_;
+    // The set of valid URIs.
+    URIFile file_;
 };
 
 class FileLoader : public Loader {
    public:
     ~FileLoader() override = default;
     FileLoader(std::istream* file) : file_(file){};
+    // Files read from a path are mapped into memory, where possible.
+    FileLoader(std::string path) : path_(std::move(path)){};
 
     void Load(ShuffleChain* into) override;
+    void Stream(ShuffleFeed* into) override;
+    void Sample(Reservoir* into) override;
+    // The file is only read once, and does not depend on MPD's database,
+    // so reloading leaves the chain as it is.
+    void Reload(ShuffleChain*) override{};
+
+   private:
+    template <typename Sink>
+    void LoadInto(Sink* into);
+
+    // The file is read from `path_`, if it is set, or from `file_`.
+    std::istream* file_ = nullptr;
+    std::string path_;
+};
+
+// BackgroundLoad runs a Loader on its own thread, streaming songs into a
+// chain through a ShuffleFeed, so that songs can be picked before the whole
+// library is loaded. The chain must only be used from the thread that owns
+// the BackgroundLoad.
+class BackgroundLoad {
+   public:
+    // Start loading into `chain` with `loader`. If the loader uses an MPD
+    // connection, it must not be used by any other thread during the load,
+    // and it can be passed as `mpd` to be closed once the load is done.
+    BackgroundLoad(std::unique_ptr<mpd::MPD> mpd,
+                   std::unique_ptr<Loader> loader, ShuffleChain* chain);
+
+    // Waits for the load to finish.
+    ~BackgroundLoad();
+
+    // Wait until at least `count` songs are in the chain, or at least one
+    // song is in the chain and `budget` has passed, or the load is done.
+    void WaitForStart(size_t count, std::chrono::milliseconds budget);
+
+    // Add the songs loaded so far to the chain, without waiting on the
+    // loader. Returns true once every song has been added, and the loader
+    // (and its connection) have been released.
+    bool Drain();
 
    private:
-    std::istream* file_;
+    std::unique_ptr<mpd::MPD> mpd_;
+    std::unique_ptr<Loader> loader_;
+    ShuffleChain* chain_;
+    ShuffleFeed feed_;
+    std::thread thread_;
 };
 
 }  // namespace ashuffle
@@ -1,34 +1,60 @@
 #include <stdlib.h>
 #include <time.h>
 #include <cassert>
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include <absl/strings/str_format.h>
+#include <absl/types/span.h>
 #include <mpd/connection.h>
 
 #include "args.h"
 #include "ashuffle.h"
 #include "getpass.h"
+#include "library_cache.h"
 #include "load.h"
 #include "mpd_client.h"
+#include "random.h"
+#include "reservoir.h"
 #include "shuffle.h"
+#include "state_file.h"
+#include "uri_file.h"
 
 using namespace ashuffle;
 
 namespace {
 
 std::unique_ptr<Loader> BuildLoader(mpd::MPD* mpd, const Options& opts) {
-    if (opts.file_in != nullptr && opts.check_uris) {
-        return std::make_unique<FileMPDLoader>(mpd, opts.ruleset, opts.group_by,
-                                               opts.file_in);
-    } else if (opts.file_in != nullptr) {
+    if (opts.file_in != nullptr && !opts.check_uris) {
+        if (!opts.file_path.empty()) {
+            return std::make_unique<FileLoader>(opts.file_path);
+        }
         return std::make_unique<FileLoader>(opts.file_in);
     }
 
-    return std::make_unique<MPDLoader>(mpd, opts.ruleset, opts.group_by);
+    std::unique_ptr<MPDLoader> loader;
+    if (opts.file_in != nullptr) {
+        URIFile file = opts.file_path.empty()
+                           ? URIFile::Read(opts.file_in)
+                           : URIFile::Open(opts.file_path);
+        loader = std::make_unique<FileMPDLoader>(
+            mpd, opts.ruleset, opts.group_by, opts.spread_by, std::move(file));
+    } else {
+        loader = std::make_unique<MPDLoader>(mpd, opts.ruleset, opts.group_by,
+                                             opts.spread_by);
+    }
+    loader->SetVerifyThreads(opts.tweak.load_threads);
+    if (!opts.tweak.library_cache.empty()) {
+        loader->SetCache(LibraryCache(opts.tweak.library_cache));
+    }
+    return loader;
 }
 
 }  // namespace
@@ -62,36 +88,119 @@ int main(int argc, const char* argv[]) {
         std::cerr << "-g/--group-by not supported with no-check" << std::endl;
         exit(EXIT_FAILURE);
     }
+    if (!options.check_uris && !options.spread_by.empty()) {
+        std::cerr << "--spread-by not supported with no-check" << std::endl;
+        exit(EXIT_FAILURE);
+    }
 
-    std::function<std::string()> pass_f = [] {
-        return GetPass(stdin, stdout, "mpd password: ");
+    std::optional<std::string> password;
+    std::function<std::string()> pass_f = [&password] {
+        password = GetPass(stdin, stdout, "mpd password: ");
+        return *password;
     };
     /* attempt to connect to MPD */
     std::unique_ptr<mpd::MPD> mpd =
         Connect(*mpd::client::Dialer(), options, pass_f);
 
-    ShuffleChain songs((size_t)options.tweak.window_size);
+    uint64_t seed = options.tweak.seed ? *options.tweak.seed : RandomSeed();
+    size_t window = options.tweak.full_cycle
+                        ? ShuffleChain::kFullCycle
+                        : (size_t)options.tweak.window_size;
+    ShuffleChain songs(window, options.tweak.pool_compression,
+                       Xoshiro256(seed));
+    if (!options.spread_by.empty()) {
+        songs.SetTagCooldown((size_t)options.tweak.spread_distance);
+    }
 
-    {
-        // We construct the loader in a new scope, since loaders can
-        // consume a lot of memory.
-        std::unique_ptr<Loader> loader = BuildLoader(mpd.get(), options);
+    // With --only, the whole library doesn't need to be kept in memory:
+    // a random sample of --only songs (or groups) is enough. Spreading out
+    // tags, and restoring state, need the full chain.
+    // The loader is kept for the life of the process, so that reloads
+    // (see Loop) use the same settings, and caches, as the first load.
+    std::unique_ptr<Loader> loader;
+    bool sampled = false;
+    if (options.queue_only && options.tweak.state_file.empty() &&
+        options.spread_by.empty() && !options.test.print_all_songs_and_exit) {
+        Reservoir reservoir(options.queue_only, Xoshiro256(seed));
+        loader = BuildLoader(mpd.get(), options);
+        loader->Sample(&reservoir);
+        std::vector<std::vector<std::string>> sample = reservoir.Take();
+        if (sample.size() == options.queue_only) {
+            std::vector<std::string_view> picked;
+            for (const std::vector<std::string>& item : sample) {
+                picked.insert(picked.end(), item.begin(), item.end());
+            }
+            mpd->Add(picked);
+            std::cout << "Added " << options.queue_only << " songs."
+                      << std::endl;
+            return 0;
+        }
+        // There are fewer songs than were asked for, so some have to be
+        // repeated. Pick them from a chain of the whole sample, as usual.
+        for (const std::vector<std::string>& item : sample) {
+            if (options.group_by.empty()) {
+                songs.Add(item[0]);
+            } else {
+                songs.Add(ShuffleItem(item));
+            }
+        }
+        sampled = true;
+    }
+
+    // Streaming startup only helps when ashuffle keeps running after the
+    // first pick. Restoring state needs the full chain, since saved songs
+    // that are not loaded yet would be dropped.
+    std::optional<BackgroundLoad> background;
+    if (options.tweak.stream_startup > 0 && !options.queue_only &&
+        options.tweak.state_file.empty() &&
+        !options.test.print_all_songs_and_exit) {
+        // A loader that talks to MPD gets its own connection, since the main
+        // connection is used to enqueue songs while the library is loading.
+        // It re-uses the password entered for the main connection, if any.
+        // Input files read with no-check never need one.
+        std::unique_ptr<mpd::MPD> conn;
+        if (options.file_in == nullptr || options.check_uris) {
+            std::function<std::string()> reuse_f = [&password, &pass_f] {
+                return password ? *std::exchange(password, std::nullopt)
+                                : pass_f();
+            };
+            conn = Connect(*mpd::client::Dialer(), options, reuse_f);
+        }
+        std::unique_ptr<Loader> streamer = BuildLoader(conn.get(), options);
+        background.emplace(std::move(conn), std::move(streamer), &songs);
+        // Input files can only be read once, by the background loader, so
+        // songs are only reloaded when they are loaded from MPD.
+        if (options.file_in == nullptr) {
+            loader = BuildLoader(mpd.get(), options);
+        }
+        background->WaitForStart(
+            options.tweak.stream_startup,
+            std::chrono::milliseconds(options.tweak.stream_startup_ms));
+        if (background->Drain()) {
+            // The whole library loaded within the budget.
+            background.reset();
+            songs.Compact();
+        }
+    } else if (!sampled) {
+        loader = BuildLoader(mpd.get(), options);
         loader->Load(&songs);
+        // Compress the pool (if enabled) before we start picking.
+        songs.Compact();
     }
 
     // For integration testing, we sometimes just want to have ashuffle
     // dump the list of songs in its shuffle chain.
     if (options.test.print_all_songs_and_exit) {
         bool first = true;
-        for (auto&& group : songs.Items()) {
+        songs.ForEach([&first](absl::Span<const std::string_view> group) {
             if (!first) {
                 std::cout << "---" << std::endl;
             }
             first = false;
-            for (auto&& song : group) {
+            for (std::string_view song : group) {
                 std::cout << song << std::endl;
             }
-        }
+        });
         exit(EXIT_SUCCESS);
     }
 
@@ -100,7 +209,10 @@ int main(int argc, const char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (!options.group_by.empty()) {
+    if (background) {
+        std::cout << "Picking random songs out of the first " << songs.Len()
+                  << " songs while the library loads." << std::endl;
+    } else if (!options.group_by.empty()) {
         std::cout << absl::StrFormat("Picking from %u groups (%u songs).",
                                      songs.Len(), songs.LenURIs())
                   << std::endl;
@@ -109,14 +221,45 @@ int main(int argc, const char* argv[]) {
                   << "." << std::endl;
     }
 
+    std::optional<StateFile> state;
+    if (!options.tweak.state_file.empty()) {
+        state.emplace(options.tweak.state_file);
+        auto restored = state->Restore(&songs);
+        if (std::string* err = std::get_if<std::string>(&restored);
+            err != nullptr) {
+            std::cerr << "warning: " << *err << std::endl;
+        } else if (auto& result =
+                       std::get<ShuffleChain::RestoreResult>(restored);
+                   result.window_saved > 0) {
+            std::cout << absl::StrFormat(
+                             "Restored %u of %u upcoming songs from '%s'.",
+                             result.window_restored, result.window_saved,
+                             options.tweak.state_file)
+                      << std::endl;
+        } else if (result.played_saved > 0) {
+            std::cout << absl::StrFormat(
+                             "Restored %u of %u songs played in this cycle "
+                             "from '%s'.",
+                             result.played_restored, result.played_saved,
+                             options.tweak.state_file)
+                      << std::endl;
+        }
+    }
+
     /* do the main action */
     if (options.queue_only) {
-        for (unsigned i = 0; i < options.queue_only; i++) {
-            mpd->Add(songs.Pick());
-        }
+        std::vector<std::string_view> picked;
+        songs.PickN(options.queue_only, &picked);
+        mpd->Add(picked);
         std::cout << "Added " << options.queue_only << " songs." << std::endl;
+        if (state) {
+            if (std::optional<std::string> err = state->Save(songs); err) {
+                std::cerr << "warning: " << *err << std::endl;
+            }
+        }
     } else {
-        Loop(mpd.get(), &songs, options);
+        Loop(mpd.get(), &songs, options, loader.get(), TestDelegate(),
+             background ? &*background : nullptr);
     }
 
     return 0;
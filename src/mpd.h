@@ -1,6 +1,8 @@
 #ifndef __ASHUFFLE_MPD_H__
 #define __ASHUFFLE_MPD_H__
 
+#include <ctime>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
@@ -8,6 +10,7 @@
 #include <variant>
 #include <vector>
 
+#include <absl/types/span.h>
 #include <mpd/idle.h>
 #include <mpd/status.h>
 #include <mpd/tag.h>
@@ -31,8 +34,20 @@ class Song {
     // Get the given tag for this song.
     virtual std::optional<std::string> Tag(enum mpd_tag_type tag) const = 0;
 
-    // Returns the URI of this song.
-    virtual std::string URI() const = 0;
+    // Like Tag, but without a copy. The returned view is valid for the
+    // lifetime of the song.
+    virtual std::optional<std::string_view> TagView(
+        enum mpd_tag_type tag) const = 0;
+
+    // Get every value of the given tag for this song, in order (e.g., every
+    // artist of a song with several). Tag and TagView return only the first.
+    // The returned views are valid for the lifetime of the song.
+    virtual std::vector<std::string_view> TagValues(
+        enum mpd_tag_type tag) const = 0;
+
+    // Returns the URI of this song. The returned view is valid for the
+    // lifetime of the song.
+    virtual std::string_view URI() const = 0;
 };
 
 class Status {
@@ -95,6 +110,15 @@ struct IdleEventSet {
 
 // Address represents the dial address of a given MPD instance.
 
+// An Exclusion leaves the songs where any value of `tag` contains `value`
+// out of a song list. Values are matched ignoring case. Exclusions are
+// applied by MPD's own filters, with their rules (e.g., songs without an
+// AlbumArtist tag are matched on their Artist tag).
+struct Exclusion {
+    enum mpd_tag_type tag;
+    std::string value;
+};
+
 // MPD represents a connection to an MPD instance.
 class MPD {
    public:
@@ -116,26 +140,56 @@ class MPD {
     // database.
     virtual std::unique_ptr<SongReader> ListAll() = 0;
 
+    // ListAll also works with a list of tags, and a list of exclusions.
+    // Only the given tags are needed on the listed songs, and songs that
+    // match an exclusion may be left out, though implementations may list
+    // more of either. Leaving out unneeded tags and songs makes listing a
+    // large database cheaper, but callers must still check each song.
+    std::unique_ptr<SongReader> ListAll(
+        absl::Span<const enum mpd_tag_type> tags,
+        absl::Span<const Exclusion> exclude = {}) {
+        return ListAllMatching(tags, exclude);
+    }
+
+    // Returns a song reader over the songs whose files were modified at,
+    // or after, `since`, with the given tags (see ListAll). Returns nullptr
+    // if this MPD can not list modified songs.
+    virtual std::unique_ptr<SongReader> ListModifiedSince(
+        time_t since, absl::Span<const enum mpd_tag_type> tags) = 0;
+
+    // Calls `f` with the URI of every song in MPD's database. This is much
+    // cheaper than ListAll, since no tags are sent.
+    virtual void ListURIs(const std::function<void(std::string_view)>& f) = 0;
+
+    // Returns the time of MPD's last database update, or 0 if MPD does
+    // not know it (e.g., for some database plugins).
+    virtual time_t DatabaseUpdated() = 0;
+
+    // Returns the number of songs in MPD's database.
+    virtual unsigned DatabaseSongs() = 0;
+
     // Searches MPD's DB for a particular song URI, and returns that song.
     // Returns an empty optional if the song could not be found.
     virtual std::optional<std::unique_ptr<Song>> Search(
         std::string_view uri) = 0;
 
+    // Search also works on lists of URIs. The songs that were found are
+    // returned in the order of their URIs, with every tag.
+    std::vector<std::unique_ptr<Song>> Search(
+        absl::Span<const std::string_view> uris) {
+        return SearchBatch(uris);
+    }
+
     // Blocks until one of the enum mpd_idle events in the event set happens.
     // A new event set is returned, containing all events that occured during
     // the idle period.
     virtual IdleEventSet Idle(const IdleEventSet&) = 0;
 
     // Add, adds the song wit the given URI to the MPD queue.
-    virtual void Add(const std::string& uri) = 0;
+    virtual void Add(std::string_view uri) = 0;
 
-    // Add also works on vectors of URIs, by repeatedly invoking Add for each
-    // element.
-    void Add(const std::vector<std::string>& uris) {
-        for (auto& u : uris) {
-            Add(u);
-        }
-    };
+    // Add also works on lists of URIs. All URIs are added, in order.
+    void Add(absl::Span<const std::string_view> uris) { AddBatch(uris); };
 
     enum PasswordStatus {
         kAccepted,
@@ -159,6 +213,37 @@ class MPD {
     // the MPD connection.
     virtual Authorization CheckCommands(
         const std::vector<std::string_view>& cmds) = 0;
+
+   protected:
+    // AddBatch implements Add for lists of URIs. By default, it invokes Add
+    // for each element, but implementations can override it to add many
+    // URIs at once.
+    virtual void AddBatch(absl::Span<const std::string_view> uris) {
+        for (std::string_view u : uris) {
+            Add(u);
+        }
+    }
+
+    // SearchBatch implements Search for lists of URIs. By default, it
+    // invokes Search for each element.
+    virtual std::vector<std::unique_ptr<Song>> SearchBatch(
+        absl::Span<const std::string_view> uris) {
+        std::vector<std::unique_ptr<Song>> songs;
+        for (std::string_view u : uris) {
+            std::optional<std::unique_ptr<Song>> song = Search(u);
+            if (song) {
+                songs.push_back(std::move(*song));
+            }
+        }
+        return songs;
+    }
+
+    // ListAllMatching implements ListAll for lists of tags and exclusions.
+    // By default, it lists every song, with all of its tags.
+    virtual std::unique_ptr<SongReader> ListAllMatching(
+        absl::Span<const enum mpd_tag_type>, absl::Span<const Exclusion>) {
+        return ListAll();
+    }
 };
 
 struct Address {
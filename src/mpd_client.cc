@@ -1,22 +1,30 @@
 #include "mpd_client.h"
 
+#include <algorithm>
 #include <iostream>
 
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
+#include <absl/strings/str_join.h>
+#include <absl/types/span.h>
 #include <mpd/capabilities.h>
 #include <mpd/connection.h>
 #include <mpd/database.h>
 #include <mpd/error.h>
 #include <mpd/idle.h>
+#include <mpd/list.h>
 #include <mpd/pair.h>
 #include <mpd/password.h>
 #include <mpd/player.h>
 #include <mpd/protocol.h>
 #include <mpd/queue.h>
 #include <mpd/recv.h>
+#include <mpd/response.h>
 #include <mpd/search.h>
 #include <mpd/song.h>
+#include <mpd/stats.h>
 #include <mpd/status.h>
+#include <mpd/version.h>
 
 #include "mpd.h"
 #include "util.h"
@@ -63,7 +71,11 @@ class SongImpl : public Song {
     ~SongImpl() override;
 
     std::optional<std::string> Tag(enum mpd_tag_type tag) const override;
-    std::string URI() const override;
+    std::optional<std::string_view> TagView(
+        enum mpd_tag_type tag) const override;
+    std::vector<std::string_view> TagValues(
+        enum mpd_tag_type tag) const override;
+    std::string_view URI() const override;
 
    private:
     // The wrapped song.
@@ -80,7 +92,28 @@ std::optional<std::string> SongImpl::Tag(enum mpd_tag_type tag) const {
     return std::string(raw_value);
 }
 
-std::string SongImpl::URI() const { return mpd_song_get_uri(song_); }
+std::optional<std::string_view> SongImpl::TagView(
+    enum mpd_tag_type tag) const {
+    const char* raw_value = mpd_song_get_tag(song_, tag, 0);
+    if (raw_value == nullptr) {
+        return std::nullopt;
+    }
+    return std::string_view(raw_value);
+}
+
+std::vector<std::string_view> SongImpl::TagValues(
+    enum mpd_tag_type tag) const {
+    std::vector<std::string_view> values;
+    for (unsigned idx = 0;; idx++) {
+        const char* raw_value = mpd_song_get_tag(song_, tag, idx);
+        if (raw_value == nullptr) {
+            return values;
+        }
+        values.push_back(raw_value);
+    }
+}
+
+std::string_view SongImpl::URI() const { return mpd_song_get_uri(song_); }
 
 class StatusImpl : public Status {
    public:
@@ -147,13 +180,26 @@ class MPDImpl : public MPD {
     void PlayAt(unsigned position) override;
     std::unique_ptr<Status> CurrentStatus() override;
     std::unique_ptr<SongReader> ListAll() override;
+    std::unique_ptr<SongReader> ListModifiedSince(
+        time_t since, absl::Span<const enum mpd_tag_type> tags) override;
+    void ListURIs(const std::function<void(std::string_view)>& f) override;
+    time_t DatabaseUpdated() override;
+    unsigned DatabaseSongs() override;
     std::optional<std::unique_ptr<Song>> Search(std::string_view uri) override;
     IdleEventSet Idle(const IdleEventSet&) override;
-    void Add(const std::string& uri) override;
+    void Add(std::string_view uri) override;
     MPD::PasswordStatus ApplyPassword(const std::string& password) override;
     Authorization CheckCommands(
         const std::vector<std::string_view>& cmds) override;
 
+   protected:
+    void AddBatch(absl::Span<const std::string_view> uris) override;
+    std::vector<std::unique_ptr<Song>> SearchBatch(
+        absl::Span<const std::string_view> uris) override;
+    std::unique_ptr<SongReader> ListAllMatching(
+        absl::Span<const enum mpd_tag_type> tags,
+        absl::Span<const Exclusion> exclude) override;
+
    private:
     friend SongReaderImpl;
     struct mpd_connection* mpd_;
@@ -164,11 +210,19 @@ class MPDImpl : public MPD {
     // Checks to see if the MPD connection has an error. If it does, it
     // calls Fail.
     void CheckFail();
+
+    // Limits the tags sent with songs to `tags`, if MPD supports it.
+    // Returns true if the tags must be restored once the songs are read.
+    bool ProjectTags(absl::Span<const enum mpd_tag_type> tags);
 };
 
 class SongReaderImpl : public SongReader {
    public:
-    SongReaderImpl(MPDImpl& mpd) : mpd_(mpd), song_(std::nullopt){};
+    SongReaderImpl(MPDImpl& mpd) : SongReaderImpl(mpd, false){};
+    // If `restore_tags` is true, all tag types are re-enabled on the
+    // connection once the last song is read.
+    SongReaderImpl(MPDImpl& mpd, bool restore_tags)
+        : mpd_(mpd), song_(std::nullopt), restore_tags_(restore_tags){};
 
     // SongReaderImpl is also pointer owning (the pointer to the next song_).
     SongReaderImpl(SongReaderImpl&) = delete;
@@ -192,6 +246,7 @@ class SongReaderImpl : public SongReader {
 
     MPDImpl& mpd_;
     std::optional<std::unique_ptr<Song>> song_;
+    bool restore_tags_;
 };
 
 void SongReaderImpl::FetchNext() {
@@ -210,6 +265,12 @@ void SongReaderImpl::FetchNext() {
     mpd_.CheckFail();
     if (raw_song == nullptr) {
         song_ = std::nullopt;
+#if LIBMPDCLIENT_CHECK_VERSION(2, 19, 0)
+        if (std::exchange(restore_tags_, false) &&
+            !mpd_run_all_tag_types(mpd_.mpd_)) {
+            mpd_.Fail();
+        }
+#endif
         return;
     }
     song_ = std::unique_ptr<Song>(new SongImpl(raw_song));
@@ -264,6 +325,166 @@ std::unique_ptr<SongReader> MPDImpl::ListAll() {
     return std::unique_ptr<SongReader>(new SongReaderImpl(*this));
 }
 
+#if LIBMPDCLIENT_CHECK_VERSION(2, 15, 0)
+// MPD reads each command into a 4 KiB buffer, and closes the connection on
+// longer commands. Filter expressions are kept well under that, leaving
+// room for the command name, and libmpdclient's quoting.
+constexpr size_t kMaxFilterSize = 3072;
+
+// Returns the size of `s` once libmpdclient has quoted it as an argument.
+size_t QuotedSize(std::string_view s) {
+    return s.size() + std::count_if(s.begin(), s.end(), [](char c) {
+               return c == '"' || c == '\\';
+           });
+}
+
+// Returns a filter expression (MPD 0.21+) matching the songs that are not
+// excluded, or an empty string if there are no exclusions. Exclusions that
+// would make the expression too long are left out.
+std::string FilterExpression(absl::Span<const Exclusion> exclude) {
+    std::vector<std::string> conditions;
+    size_t size = 2;
+    for (const Exclusion& e : exclude) {
+        std::string value;
+        for (char c : e.value) {
+            if (c == '\\' || c == '\'' || c == '"') {
+                value.push_back('\\');
+            }
+            value.push_back(c);
+        }
+        std::string condition = absl::StrCat("(!(", mpd_tag_name(e.tag),
+                                             " contains '", value, "'))");
+        // Each condition after the first is joined with " AND ".
+        size_t condition_size =
+            QuotedSize(condition) + (conditions.empty() ? 0 : 5);
+        if (size + condition_size > kMaxFilterSize) {
+            break;
+        }
+        size += condition_size;
+        conditions.push_back(std::move(condition));
+    }
+    if (conditions.empty()) {
+        return "";
+    }
+    if (conditions.size() == 1) {
+        return conditions[0];
+    }
+    return absl::StrCat("(", absl::StrJoin(conditions, " AND "), ")");
+}
+#endif
+
+bool MPDImpl::ProjectTags(absl::Span<const enum mpd_tag_type> tags) {
+#if LIBMPDCLIENT_CHECK_VERSION(2, 19, 0)
+    // `tagtypes clear` and `tagtypes all` were added in MPD 0.21.
+    if (mpd_connection_cmp_server_version(mpd_, 0, 21, 0) < 0) {
+        return false;
+    }
+    if (!mpd_run_clear_tag_types(mpd_)) {
+        Fail();
+    }
+    if (!tags.empty() &&
+        !mpd_run_enable_tag_types(mpd_, tags.data(), tags.size())) {
+        Fail();
+    }
+    return true;
+#else
+    (void)tags;
+    return false;
+#endif
+}
+
+std::unique_ptr<SongReader> MPDImpl::ListAllMatching(
+    absl::Span<const enum mpd_tag_type> tags,
+    absl::Span<const Exclusion> exclude) {
+    // Filter expressions were added in MPD 0.21. Older versions list every
+    // song, with every tag.
+    if (mpd_connection_cmp_server_version(mpd_, 0, 21, 0) < 0) {
+        return ListAll();
+    }
+    bool restore_tags = ProjectTags(tags);
+#if LIBMPDCLIENT_CHECK_VERSION(2, 15, 0)
+    std::string filter = FilterExpression(exclude);
+    if (!filter.empty()) {
+        // `search` (rather than `find`) matches values ignoring case, like
+        // Rule::Accepts. Rule::AppendExclusions only passes ASCII values,
+        // which MPD folds the same way.
+        if (!mpd_search_db_songs(mpd_, false) ||
+            !mpd_search_add_expression(mpd_, filter.data()) ||
+            !mpd_search_commit(mpd_)) {
+            Fail();
+        }
+        return std::unique_ptr<SongReader>(
+            new SongReaderImpl(*this, restore_tags));
+    }
+#else
+    (void)exclude;
+#endif
+    if (!mpd_send_list_all_meta(mpd_, NULL)) {
+        Fail();
+    }
+    return std::unique_ptr<SongReader>(
+        new SongReaderImpl(*this, restore_tags));
+}
+
+std::unique_ptr<SongReader> MPDImpl::ListModifiedSince(
+    time_t since, absl::Span<const enum mpd_tag_type> tags) {
+#if LIBMPDCLIENT_CHECK_VERSION(2, 10, 0)
+    // The modified-since filter was added in MPD 0.18.
+    if (mpd_connection_cmp_server_version(mpd_, 0, 18, 0) < 0) {
+        return nullptr;
+    }
+    bool restore_tags = ProjectTags(tags);
+    if (!mpd_search_db_songs(mpd_, true) ||
+        !mpd_search_add_modified_since_constraint(mpd_, MPD_OPERATOR_DEFAULT,
+                                                  since) ||
+        !mpd_search_commit(mpd_)) {
+        Fail();
+    }
+    return std::unique_ptr<SongReader>(
+        new SongReaderImpl(*this, restore_tags));
+#else
+    (void)since;
+    (void)tags;
+    return nullptr;
+#endif
+}
+
+void MPDImpl::ListURIs(const std::function<void(std::string_view)>& f) {
+    if (!mpd_send_list_all(mpd_, NULL)) {
+        Fail();
+    }
+    // `listall` also lists directories and playlists, which are skipped.
+    struct mpd_pair* pair;
+    while ((pair = mpd_recv_pair_named(mpd_, "file")) != nullptr) {
+        f(pair->value);
+        mpd_return_pair(mpd_, pair);
+    }
+    CheckFail();
+    if (!mpd_response_finish(mpd_)) {
+        Fail();
+    }
+}
+
+time_t MPDImpl::DatabaseUpdated() {
+    struct mpd_stats* stats = mpd_run_stats(mpd_);
+    if (stats == nullptr) {
+        Fail();
+    }
+    time_t updated = mpd_stats_get_db_update_time(stats);
+    mpd_stats_free(stats);
+    return updated;
+}
+
+unsigned MPDImpl::DatabaseSongs() {
+    struct mpd_stats* stats = mpd_run_stats(mpd_);
+    if (stats == nullptr) {
+        Fail();
+    }
+    unsigned songs = mpd_stats_get_number_of_songs(stats);
+    mpd_stats_free(stats);
+    return songs;
+}
+
 std::optional<std::unique_ptr<Song>> MPDImpl::Search(std::string_view uri) {
     // Copy to ensure URI buffer is null-terminated.
     std::string uri_copy(uri);
@@ -289,18 +510,89 @@ std::optional<std::unique_ptr<Song>> MPDImpl::Search(std::string_view uri) {
     return std::optional<std::unique_ptr<Song>>(std::move(song));
 }
 
+std::vector<std::unique_ptr<Song>> MPDImpl::SearchBatch(
+    absl::Span<const std::string_view> uris) {
+    // Like AddBatch, searches are sent in bounded command lists. Each
+    // search's songs end with a list_OK, so the results of each search can
+    // be told apart.
+    constexpr size_t kMaxBatch = 512;
+    std::vector<std::unique_ptr<Song>> songs;
+    while (!uris.empty()) {
+        absl::Span<const std::string_view> batch =
+            uris.first(std::min(kMaxBatch, uris.size()));
+        uris.remove_prefix(batch.size());
+        if (!mpd_command_list_begin(mpd_, true)) {
+            Fail();
+        }
+        for (std::string_view uri : batch) {
+            // Copy to ensure URI buffer is null-terminated.
+            std::string uri_copy(uri);
+            if (!mpd_search_db_songs(mpd_, true) ||
+                !mpd_search_add_uri_constraint(mpd_, MPD_OPERATOR_DEFAULT,
+                                               uri_copy.data()) ||
+                !mpd_search_commit(mpd_)) {
+                Fail();
+            }
+        }
+        if (!mpd_command_list_end(mpd_)) {
+            Fail();
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            struct mpd_song* raw_song;
+            while ((raw_song = mpd_recv_song(mpd_)) != nullptr) {
+                songs.emplace_back(new SongImpl(raw_song));
+            }
+            CheckFail();
+            if (i + 1 < batch.size() && !mpd_response_next(mpd_)) {
+                Fail();
+            }
+        }
+        if (!mpd_response_finish(mpd_)) {
+            Fail();
+        }
+    }
+    return songs;
+}
+
 IdleEventSet MPDImpl::Idle(const IdleEventSet& events) {
     enum mpd_idle occured = mpd_run_idle_mask(mpd_, events.Enum());
     CheckFail();
     return {static_cast<int>(occured)};
 }
 
-void MPDImpl::Add(const std::string& uri) {
-    if (!mpd_run_add(mpd_, uri.data())) {
+void MPDImpl::Add(std::string_view uri) {
+    // Copy to ensure URI buffer is null-terminated.
+    std::string uri_copy(uri);
+    if (!mpd_run_add(mpd_, uri_copy.data())) {
         Fail();
     }
 }
 
+void MPDImpl::AddBatch(absl::Span<const std::string_view> uris) {
+    // Send the adds in command lists, so that a whole batch only needs a
+    // single round-trip. Batches are bounded, to stay well under MPD's
+    // default command list size limit (max_command_list_size, 2 MiB).
+    constexpr size_t kMaxBatch = 512;
+    while (!uris.empty()) {
+        absl::Span<const std::string_view> batch =
+            uris.first(std::min(kMaxBatch, uris.size()));
+        uris.remove_prefix(batch.size());
+        if (!mpd_command_list_begin(mpd_, false)) {
+            Fail();
+        }
+        for (std::string_view uri : batch) {
+            // Copy to ensure URI buffer is null-terminated.
+            std::string uri_copy(uri);
+            if (!mpd_send_add(mpd_, uri_copy.data())) {
+                Fail();
+            }
+        }
+        if (!mpd_command_list_end(mpd_) || !mpd_response_finish(mpd_)) {
+            Fail();
+        }
+    }
+}
+
 std::unique_ptr<Status> MPDImpl::CurrentStatus() {
     struct mpd_status* status = mpd_run_status(mpd_);
     if (status == nullptr) {
@@ -0,0 +1,31 @@
+#include "random.h"
+
+#include <random>
+
+namespace ashuffle {
+
+namespace {
+
+// SplitMix64, used to expand a single 64-bit seed into a full xoshiro state.
+uint64_t SplitMix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+}  // namespace
+
+Xoshiro256::Xoshiro256(uint64_t seed) {
+    for (uint64_t& s : s_) {
+        s = SplitMix64(&seed);
+    }
+}
+
+uint64_t RandomSeed() {
+    std::random_device rd;
+    // random_device only produces 32-bit values.
+    return (static_cast<uint64_t>(rd()) << 32) | rd();
+}
+
+}  // namespace ashuffle
@@ -0,0 +1,128 @@
+#ifndef __ASHUFFLE_RANDOM_H__
+#define __ASHUFFLE_RANDOM_H__
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+#include <absl/numeric/int128.h>
+
+namespace ashuffle {
+
+// Xoshiro256 is the xoshiro256** pseudo-random number generator by Blackman
+// and Vigna. It has 32 bytes of state, is cheap to seed, and is much faster
+// than std::mt19937, while still having excellent statistical quality for
+// non-cryptographic use. It satisfies the standard UniformRandomBitGenerator
+// requirements, so it can be used with <random> distributions.
+class Xoshiro256 {
+   public:
+    using result_type = uint64_t;
+    using State = std::array<uint64_t, 4>;
+
+    // Create a new generator from a 64-bit seed. The seed is expanded to the
+    // full generator state using SplitMix64, as recommended by the authors.
+    explicit Xoshiro256(uint64_t seed);
+
+    // Create a new generator with the given state. The state must not be all
+    // zeros.
+    explicit Xoshiro256(const State& state) : s_(state){};
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+        const uint64_t result = Rotl(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = Rotl(s_[3], 45);
+        return result;
+    }
+
+    // Returns the current state of this generator. A generator constructed
+    // with the returned state produces the same sequence as this one.
+    const State& GetState() const { return s_; }
+
+   private:
+    static uint64_t Rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    State s_;
+};
+
+// Returns a seed drawn from std::random_device.
+uint64_t RandomSeed();
+
+// Returns 32 uniformly distributed bits from the given generator. The
+// generator must produce the full range of either 32 or 64-bit integers.
+template <typename URBG>
+uint32_t Bits32(URBG& g) {
+    static_assert(URBG::min() == 0, "generator must start at 0");
+    if constexpr (URBG::max() == std::numeric_limits<uint32_t>::max()) {
+        return static_cast<uint32_t>(g());
+    } else {
+        static_assert(URBG::max() == std::numeric_limits<uint64_t>::max(),
+                      "generator must produce 32 or 64 bit values");
+        // The high bits are the strongest bits of most generators.
+        return static_cast<uint32_t>(g() >> 32);
+    }
+}
+
+// Returns 64 uniformly distributed bits from the given generator. 32-bit
+// generators are called twice.
+template <typename URBG>
+uint64_t Bits64(URBG& g) {
+    if constexpr (URBG::max() == std::numeric_limits<uint64_t>::max()) {
+        static_assert(URBG::min() == 0, "generator must start at 0");
+        return g();
+    } else {
+        uint64_t high = Bits32(g);
+        return (high << 32) | Bits32(g);
+    }
+}
+
+// Bounded returns a uniformly distributed integer in [0, range), without
+// bias. It uses Lemire's "nearly divisionless" method: a random 32-bit value
+// is multiplied by `range`, and the high 32 bits of the product are the
+// result. A (slow) modulo is only needed in the rare case that the low bits
+// of the product indicate the result could be biased.
+// See: https://arxiv.org/abs/1805.10941
+template <typename URBG>
+uint32_t Bounded(URBG& g, uint32_t range) {
+    uint64_t m = static_cast<uint64_t>(Bits32(g)) * range;
+    uint32_t low = static_cast<uint32_t>(m);
+    if (low < range) {
+        // threshold is 2^32 mod range.
+        uint32_t threshold = (0u - range) % range;
+        while (low < threshold) {
+            m = static_cast<uint64_t>(Bits32(g)) * range;
+            low = static_cast<uint32_t>(m);
+        }
+    }
+    return static_cast<uint32_t>(m >> 32);
+}
+
+// Bounded64 is like Bounded, but for 64-bit ranges.
+template <typename URBG>
+uint64_t Bounded64(URBG& g, uint64_t range) {
+    absl::uint128 m = absl::uint128(Bits64(g)) * range;
+    uint64_t low = absl::Uint128Low64(m);
+    if (low < range) {
+        uint64_t threshold = (0ull - range) % range;
+        while (low < threshold) {
+            m = absl::uint128(Bits64(g)) * range;
+            low = absl::Uint128Low64(m);
+        }
+    }
+    return absl::Uint128High64(m);
+}
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_RANDOM_H__
@@ -0,0 +1,59 @@
+#include "reservoir.h"
+
+#include <utility>
+
+namespace ashuffle {
+
+size_t Reservoir::Admit() {
+    seen_++;
+    if (items_.size() < n_) {
+        items_.emplace_back();
+        return items_.size() - 1;
+    }
+    // The i'th item replaces a random slot with probability n / i, which
+    // keeps every item seen so far in the sample with probability n / i.
+    uint64_t slot = Bounded64(rng_, seen_);
+    return slot < n_ ? slot : kRejected;
+}
+
+void Reservoir::Add(std::string_view uri) {
+    if (size_t slot = Admit(); slot != kRejected) {
+        items_[slot] = {std::string(uri)};
+    }
+}
+
+void Reservoir::AddToGroup(uint64_t key, std::string_view uri) {
+    if (auto it = slot_of_.find(key); it != slot_of_.end()) {
+        items_[it->second].emplace_back(uri);
+        return;
+    }
+    if (!groups_seen_.insert(key).second) {
+        // The group was passed over (or evicted) earlier.
+        return;
+    }
+    size_t slot = Admit();
+    if (slot == kRejected) {
+        return;
+    }
+    if (slot < slot_keys_.size()) {
+        slot_of_.erase(slot_keys_[slot]);
+        slot_keys_[slot] = key;
+    } else {
+        slot_keys_.push_back(key);
+    }
+    slot_of_[key] = slot;
+    items_[slot] = {std::string(uri)};
+}
+
+std::vector<std::vector<std::string>> Reservoir::Take() {
+    // The sample is uniform, but its order is not: the first items seen
+    // are more likely to be in the first slots. Shuffle it (Fisher-Yates).
+    for (size_t i = items_.size(); i > 1; i--) {
+        std::swap(items_[i - 1], items_[Bounded64(rng_, i)]);
+    }
+    slot_of_.clear();
+    slot_keys_.clear();
+    return std::exchange(items_, {});
+}
+
+}  // namespace ashuffle
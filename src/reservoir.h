@@ -0,0 +1,63 @@
+#ifndef __ASHUFFLE_RESERVOIR_H__
+#define __ASHUFFLE_RESERVOIR_H__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "random.h"
+
+namespace ashuffle {
+
+// Reservoir keeps a uniform random sample of `n` items out of a stream of
+// items of unknown length, using memory proportional to `n`, rather than to
+// the length of the stream (reservoir sampling).
+//
+// Items are either single URIs, or groups of URIs identified by a key. The
+// URIs of a group may be spread across the stream: a group is sampled when
+// its first URI is seen, and the rest of its URIs are kept only if it is in
+// the sample. To tell new groups from ones that were already passed over,
+// the reservoir also keeps the key of every group it has seen, at 8 bytes
+// per group.
+class Reservoir {
+   public:
+    Reservoir(size_t n, Xoshiro256 rng) : n_(n), rng_(std::move(rng)){};
+
+    // Add a single URI to the stream.
+    void Add(std::string_view uri);
+
+    // Add a URI of the group with the given key to the stream.
+    void AddToGroup(uint64_t key, std::string_view uri);
+
+    // Returns the number of items (URIs, or groups) seen so far.
+    size_t Seen() const { return seen_; }
+
+    // Returns the sampled items, in random order, and empties the
+    // reservoir. If fewer than `n` items were seen, all of them are
+    // returned.
+    std::vector<std::vector<std::string>> Take();
+
+   private:
+    static constexpr size_t kRejected = SIZE_MAX;
+
+    // Count a new item, and return the slot it should be stored in, or
+    // kRejected if it is not sampled.
+    size_t Admit();
+
+    size_t n_;
+    Xoshiro256 rng_;
+    size_t seen_ = 0;
+    std::vector<std::vector<std::string>> items_;
+    // In group mode, the keys of all groups seen so far, and the slots of
+    // the sampled groups.
+    std::unordered_set<uint64_t> groups_seen_;
+    std::unordered_map<uint64_t, size_t> slot_of_;
+    std::vector<uint64_t> slot_keys_;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_RESERVOIR_H__
@@ -4,9 +4,29 @@
 #include <cassert>
 #include <cctype>
 #include <string>
+#include <string_view>
+
+#include <absl/strings/match.h>
+
+#include "fingerprint.h"
 
 namespace ashuffle {
 
+namespace {
+
+// Returns true if MPD's filters match songs that lack `tag` against another
+// tag instead: AlbumArtist falls back to Artist, and each *Sort tag (e.g.,
+// AlbumSort) to its base tag.
+bool HasFallback(enum mpd_tag_type tag) {
+    if (tag == MPD_TAG_ALBUM_ARTIST) {
+        return true;
+    }
+    const char *name = mpd_tag_name(tag);
+    return name != nullptr && absl::EndsWith(name, "Sort");
+}
+
+}  // namespace
+
 void Rule::AddPattern(enum mpd_tag_type tag, std::string value) {
     assert(tag != MPD_TAG_UNKNOWN && "cannot add unknown tag to pattern");
     std::transform(value.begin(), value.end(), value.begin(),
@@ -18,25 +38,56 @@ bool Rule::Accepts(const mpd::Song &song) const {
     assert(type_ == Rule::Type::kExclude &&
            "only exclusion rules are supported");
     for (const Pattern &p : patterns_) {
-        std::optional<std::string> tag_value = song.Tag(p.tag);
-        if (!tag_value) {
-            // If the tag doesn't exist, we can't match on it. Just skip this
-            // pattern.
-            continue;
+        // If the tag doesn't exist, there are no values, and we can't match
+        // on it. A song with several values for the tag matches if any of
+        // them does.
+        for (std::string_view value : song.TagValues(p.tag)) {
+            // Lowercase the tag value, to make sure our comparison is not
+            // case sensitive.
+            std::string tag_value(value);
+            std::transform(tag_value.begin(), tag_value.end(),
+                           tag_value.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            if (tag_value.find(p.value) != std::string::npos) {
+                return false;
+            }
         }
+    }
+    return true;
+}
 
-        // Lowercase the tag value, to make sure our comparison is not
-        // case sensitive.
-        std::transform(tag_value->begin(), tag_value->end(), tag_value->begin(),
-                       [](unsigned char c) { return std::tolower(c); });
-        if (tag_value->find(p.value) == std::string::npos) {
-            // No substring match, this pattern does not match.
+void Rule::AppendExclusions(std::vector<mpd::Exclusion> *exclude) const {
+    for (const Pattern &p : patterns_) {
+        // Some patterns would make MPD leave out songs Accepts keeps, so they
+        // are only checked by Accepts:
+        //  * MPD folds the case of non-ASCII characters too, while Accepts
+        //    only folds ASCII.
+        //  * MPD matches songs that lack some tags against a fallback tag,
+        //    while Accepts never matches songs that lack the tag.
+        //  * To MPD, an empty value matches songs that lack the tag, while
+        //    Accepts matches every song that has it.
+        bool ascii = std::all_of(p.value.begin(), p.value.end(),
+                                 [](unsigned char c) { return c < 0x80; });
+        if (!ascii || HasFallback(p.tag) || p.value.empty()) {
             continue;
         }
+        exclude->push_back(mpd::Exclusion{p.tag, p.value});
+    }
+}
+
+uint64_t Rule::Digest() const {
+    uint64_t digest = FingerprintCombine(type_, patterns_.size());
+    for (const Pattern &p : patterns_) {
+        digest = FingerprintCombine(digest, p.tag);
+        digest = FingerprintCombine(digest, Fingerprint(p.value));
+    }
+    return digest;
+}
 
-        return false;
+void Rule::AppendTags(std::vector<enum mpd_tag_type> *tags) const {
+    for (const Pattern &p : patterns_) {
+        tags->push_back(p.tag);
     }
-    return true;
 }
 
 }  // namespace ashuffle
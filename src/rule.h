@@ -1,6 +1,7 @@
 #ifndef __ASHUFFLE_RULE_H__
 #define __ASHUFFLE_RULE_H__
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -49,6 +50,20 @@ class Rule {
     // song would *not* be accepted.
     bool Accepts(const mpd::Song &song) const;
 
+    // Append the tags this rule matches on to `tags`.
+    void AppendTags(std::vector<enum mpd_tag_type> *tags) const;
+
+    // Append exclusions for MPD to `exclude`, that leave out songs this rule
+    // does not accept. Patterns that MPD matches differently from Accepts
+    // (non-ASCII or empty values, and tags MPD falls back from, like
+    // AlbumArtist) are not appended, so the exclusions never leave out a
+    // song this rule accepts.
+    void AppendExclusions(std::vector<mpd::Exclusion> *exclude) const;
+
+    // Returns a stable digest of this rule's type and patterns. Rules with
+    // the same digest accept the same songs.
+    uint64_t Digest() const;
+
    private:
     Type type_;
     std::vector<Pattern> patterns_;
@@ -1,61 +1,827 @@
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <numeric>
-#include <random>
 #include <string>
 #include <vector>
 
+#include <absl/strings/str_format.h>
+
+#include "binary_file.h"
+#include "fingerprint.h"
 #include "shuffle.h"
 
 namespace ashuffle {
 
+uint64_t ShuffleItem::Key() const {
+    if (_key) {
+        return *_key;
+    }
+    if (!_group) {
+        return Fingerprint(_single);
+    }
+    uint64_t key = _group->size();
+    for (const std::string& uri : *_group) {
+        key = FingerprintCombine(key, Fingerprint(uri));
+    }
+    return key;
+}
+
+namespace {
+
+// Checkpoints made by SaveState start with this magic, followed by the
+// format version. All integers are little-endian.
+constexpr std::string_view kStateMagic = "ASHS";
+constexpr uint32_t kStateVersion = 2;
+
+}  // namespace
+
+namespace internal {
+
+uint32_t KeyIndex::Find(uint64_t key, const std::vector<uint64_t>& keys) const {
+    if (slots_.empty()) {
+        return kNotFound;
+    }
+    for (size_t i = Home(key);; i = (i + 1) & (slots_.size() - 1)) {
+        if (slots_[i] == kEmpty) {
+            return kNotFound;
+        }
+        if (keys[slots_[i]] == key) {
+            return slots_[i];
+        }
+    }
+}
+
+void KeyIndex::Insert(uint32_t idx, const std::vector<uint64_t>& keys) {
+    // Keep the load factor at or below 3/4, so probe sequences stay short.
+    if ((size_ + 1) * 4 > slots_.size() * 3) {
+        Grow(keys);
+    }
+    size_t i = Home(keys[idx]);
+    while (slots_[i] != kEmpty) {
+        i = (i + 1) & (slots_.size() - 1);
+    }
+    slots_[i] = idx;
+    size_++;
+}
+
+size_t KeyIndex::SlotOf(uint32_t idx, const std::vector<uint64_t>& keys) const {
+    size_t i = Home(keys[idx]);
+    while (slots_[i] != idx) {
+        assert(slots_[i] != kEmpty && "item not in index");
+        i = (i + 1) & (slots_.size() - 1);
+    }
+    return i;
+}
+
+void KeyIndex::Erase(uint32_t idx, const std::vector<uint64_t>& keys) {
+    const size_t mask = slots_.size() - 1;
+    size_t hole = SlotOf(idx, keys);
+    // Instead of leaving a tombstone, shift later entries of the same probe
+    // sequence back into the hole. An entry can only move back if its home
+    // slot is not between the hole and its current slot.
+    for (size_t j = (hole + 1) & mask; slots_[j] != kEmpty;
+         j = (j + 1) & mask) {
+        size_t home = Home(keys[slots_[j]]);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            slots_[hole] = slots_[j];
+            hole = j;
+        }
+    }
+    slots_[hole] = kEmpty;
+    size_--;
+}
+
+void KeyIndex::Move(uint32_t from, uint32_t to,
+                    const std::vector<uint64_t>& keys) {
+    slots_[SlotOf(from, keys)] = to;
+}
+
+void KeyIndex::Grow(const std::vector<uint64_t>& keys) {
+    std::vector<uint32_t> old(std::max<size_t>(16, slots_.size() * 2),
+                              kEmpty);
+    std::swap(old, slots_);
+    size_ = 0;
+    for (uint32_t idx : old) {
+        if (idx != kEmpty) {
+            Insert(idx, keys);
+        }
+    }
+}
+
+void KeyIndex::Clear() {
+    slots_.clear();
+    size_ = 0;
+}
+
+}  // namespace internal
+
 void ShuffleChain::Clear() {
-    _window.clear();
+    _window.Clear();
     _pool.clear();
+    _pool_pos.clear();
+    _unplayed = 0;
+    _weighted = false;
+    _weights.clear();
+    _tree.Clear();
     _items.clear();
+    _keys.clear();
+    _index.Clear();
+    _reloading = false;
+    _seen.clear();
+    _uris.clear();
+    _arena.Clear();
+    _uri_ids.clear();
+    _dict = FrontCodedDict();
+    _dead_uris = 0;
+    _tag_dict.clear();
+    _tag_stamps.clear();
+    _next_stamp = 1;
+    _item_tags.clear();
+    _tag_ids.clear();
+    _dead_tags = 0;
+}
+
+void ShuffleChain::Add(ShuffleItem item) { Upsert(item, std::nullopt); }
+
+void ShuffleChain::Add(ShuffleItem item, uint32_t weight) {
+    Upsert(item, weight);
+}
+
+void ShuffleChain::Upsert(ShuffleItem item, std::optional<uint32_t> weight) {
+    assert((!weight || *weight >= 1) && "weight must be >= 1");
+    if (weight && *weight != 1 && !_weighted && !FullCycle()) {
+        EnableWeights();
+    }
+
+    uint64_t key = item.Key();
+    if (uint32_t idx = _index.Find(key, _keys);
+        idx != internal::KeyIndex::kNotFound) {
+        // Only rewrite the URIs if they changed, so that re-adding an
+        // unchanged item (e.g., during a reload) leaves no garbage.
+        absl::Span<const std::string_view> old = URIs(_items[idx]);
+        bool same = old.size() == item.Size();
+        for (size_t i = 0; same && i < old.size(); i++) {
+            same = old[i] == item.URI(i);
+        }
+        if (!same) {
+            _dead_uris += _items[idx].length;
+            _items[idx] = StoreURIs(item);
+        }
+        if (weight) {
+            SetWeight(idx, *weight);
+        }
+        if (_cooldown > 0) {
+            StoreTags(idx, item);
+        }
+        if (_reloading) {
+            _seen[idx] = true;
+        }
+        if (!same) {
+            CollectGarbage();
+        }
+        return;
+    }
+
+    _items.push_back(StoreURIs(item));
+    _keys.push_back(key);
+    _index.Insert(static_cast<uint32_t>(_items.size() - 1), _keys);
+    if (_cooldown > 0) {
+        StoreTags(_items.size() - 1, item);
+    }
+    if (_reloading) {
+        _seen.push_back(true);
+    }
+    if (_weighted) {
+        _weights.push_back(weight.value_or(1));
+        _tree.PushBack(weight.value_or(1));
+    } else {
+        _pool_pos.push_back(static_cast<uint32_t>(_pool.size()));
+        _pool.push_back(static_cast<uint32_t>(_items.size() - 1));
+    }
+    if (FullCycle()) {
+        // New items have not been played in the current pass.
+        SwapPool(_pool_pos.back(), _unplayed++);
+        return;
+    }
+    // The window never holds more than _max_window + 1 items, so once the
+    // chain is that large, the ring has reached its final size.
+    _window.Reserve(std::min(_items.size(), _max_window + 1));
 }
 
-void ShuffleChain::Add(ShuffleItem item) {
-    _items.emplace_back(item);
-    _pool.push_back(_items.size() - 1);
+ShuffleChain::Item ShuffleChain::StoreURIs(ShuffleItem item) {
+    assert(Slots() + item.Size() <= UINT32_MAX && "too many URIs");
+    Item stored = {
+        .offset = static_cast<uint32_t>(Slots()),
+        .length = static_cast<uint32_t>(item.Size()),
+    };
+    for (size_t i = 0; i < item.Size(); i++) {
+        _uris.push_back(_arena.Append(item.URI(i)));
+    }
+    return stored;
+}
+
+void ShuffleChain::SetTagCooldown(size_t picks) {
+    _cooldown = picks;
+    if (_cooldown == 0) {
+        _tag_dict.clear();
+        _tag_stamps.clear();
+        _item_tags.clear();
+        _tag_ids.clear();
+        _dead_tags = 0;
+        return;
+    }
+    // Items added before the cooldown was set have no tags.
+    _item_tags.resize(_items.size(), TagRange{0, 0});
+}
+
+void ShuffleChain::StoreTags(size_t idx, ShuffleItem item) {
+    _tag_scratch.clear();
+    for (size_t i = 0; i < item.TagCount(); i++) {
+        auto [it, inserted] = _tag_dict.try_emplace(
+            (*item._tags)[i], static_cast<uint32_t>(_tag_stamps.size()));
+        if (inserted) {
+            _tag_stamps.push_back(0);
+        }
+        _tag_scratch.push_back(it->second);
+    }
+    if (idx < _item_tags.size()) {
+        const TagRange& old = _item_tags[idx];
+        auto begin = _tag_ids.begin() + old.offset;
+        if (std::equal(_tag_scratch.begin(), _tag_scratch.end(), begin,
+                       begin + old.length)) {
+            return;
+        }
+        _dead_tags += old.length;
+    } else {
+        _item_tags.emplace_back();
+    }
+    _item_tags[idx] = TagRange{static_cast<uint32_t>(_tag_ids.size()),
+                               static_cast<uint32_t>(_tag_scratch.size())};
+    _tag_ids.insert(_tag_ids.end(), _tag_scratch.begin(), _tag_scratch.end());
+    if (_dead_tags * 2 > _tag_ids.size()) {
+        RepackTags();
+    }
+}
+
+void ShuffleChain::RepackTags() {
+    std::vector<uint32_t> packed;
+    packed.reserve(_tag_ids.size() - _dead_tags);
+    for (TagRange& range : _item_tags) {
+        auto begin = _tag_ids.begin() + range.offset;
+        range.offset = static_cast<uint32_t>(packed.size());
+        packed.insert(packed.end(), begin, begin + range.length);
+    }
+    _tag_ids = std::move(packed);
+    _dead_tags = 0;
+}
+
+uint64_t ShuffleChain::TagStamp(size_t idx) const {
+    uint64_t stamp = 0;
+    const TagRange& range = _item_tags[idx];
+    for (uint32_t i = range.offset; i < range.offset + range.length; i++) {
+        stamp = std::max(stamp, _tag_stamps[_tag_ids[i]]);
+    }
+    return stamp;
+}
+
+void ShuffleChain::StampTags(size_t idx) {
+    if (_cooldown == 0) {
+        return;
+    }
+    const TagRange& range = _item_tags[idx];
+    for (uint32_t i = range.offset; i < range.offset + range.length; i++) {
+        _tag_stamps[_tag_ids[i]] = _next_stamp;
+    }
+    _next_stamp++;
+}
+
+template <typename Draw>
+size_t ShuffleChain::DrawCandidate(Draw draw) {
+    size_t best = draw();
+    if (_cooldown == 0) {
+        return best;
+    }
+    // A tag is cooling down if one of the last _cooldown stamps used it.
+    auto cooling = [this](uint64_t stamp) {
+        return stamp != 0 && _next_stamp - stamp <= _cooldown;
+    };
+    uint64_t best_stamp = TagStamp(best);
+    for (int i = 1; i < kCooldownDraws && cooling(best_stamp); i++) {
+        size_t idx = draw();
+        if (uint64_t stamp = TagStamp(idx); stamp < best_stamp) {
+            best = idx;
+            best_stamp = stamp;
+        }
+    }
+    return best;
 }
 
-size_t ShuffleChain::Len() { return _items.size(); }
-size_t ShuffleChain::LenURIs() {
-    size_t sum = 0;
-    for (auto& group : _items) {
-        sum += group._uris.size();
+bool ShuffleChain::Remove(uint64_t key) {
+    uint32_t idx = _index.Find(key, _keys);
+    if (idx == internal::KeyIndex::kNotFound) {
+        return false;
     }
-    return sum;
+    RemoveIndex(idx);
+    CollectGarbage();
+    return true;
+}
+
+bool ShuffleChain::Remove(std::string_view uri) {
+    return Remove(Fingerprint(uri));
+}
+
+void ShuffleChain::RemoveIndex(size_t idx) {
+    const size_t last = _items.size() - 1;
+
+    // Take the item out of the window, or the pool.
+    bool in_window = false;
+    for (size_t i = 0; i < _window.Size(); i++) {
+        if (_window[i] == idx) {
+            _window.Erase(i);
+            in_window = true;
+            break;
+        }
+    }
+    if (!in_window) {
+        TakeFromPool(idx);
+    }
+    _dead_uris += _items[idx].length;
+    _index.Erase(static_cast<uint32_t>(idx), _keys);
+    if (_cooldown > 0) {
+        _dead_tags += _item_tags[idx].length;
+    }
+
+    // Move the last item into the hole, so that item indices stay dense.
+    if (idx != last) {
+        _index.Move(static_cast<uint32_t>(last), static_cast<uint32_t>(idx),
+                    _keys);
+        _items[idx] = _items[last];
+        _keys[idx] = _keys[last];
+        if (_reloading) {
+            _seen[idx] = _seen[last];
+        }
+        if (_cooldown > 0) {
+            _item_tags[idx] = _item_tags[last];
+        }
+        if (_weighted) {
+            _weights[idx] = _weights[last];
+            // The hole has no weight in the tree, since it was removed above.
+            _tree.Add(idx, _tree.Get(last));
+        } else {
+            _pool_pos[idx] = _pool_pos[last];
+            if (_pool_pos[idx] != kInWindow) {
+                _pool[_pool_pos[idx]] = static_cast<uint32_t>(idx);
+            }
+        }
+        for (size_t i = 0; i < _window.Size(); i++) {
+            if (_window[i] == last) {
+                _window[i] = idx;
+            }
+        }
+    }
+
+    _items.pop_back();
+    _keys.pop_back();
+    if (_reloading) {
+        _seen.pop_back();
+    }
+    if (_cooldown > 0) {
+        _item_tags.pop_back();
+        if (_dead_tags * 2 > _tag_ids.size()) {
+            RepackTags();
+        }
+    }
+    if (_weighted) {
+        _weights.pop_back();
+        _tree.PopBack();
+    } else {
+        _pool_pos.pop_back();
+    }
+}
+
+uint64_t ShuffleChain::KeyDigest() const {
+    // Keys are unique, and already well mixed, so their sum is a good
+    // order-independent digest.
+    uint64_t digest = 0;
+    for (uint64_t key : _keys) {
+        digest += key;
+    }
+    return digest;
+}
+
+std::string ShuffleChain::SaveState() const {
+    std::string out(kStateMagic);
+    PutInt<uint32_t>(&out, kStateVersion);
+    PutInt<uint64_t>(&out, _items.size());
+    PutInt<uint64_t>(&out, KeyDigest());
+
+    std::optional<Xoshiro256::State> rng = _rng->GetState();
+    PutInt<uint8_t>(&out, rng.has_value());
+    if (rng) {
+        for (uint64_t s : *rng) {
+            PutInt<uint64_t>(&out, s);
+        }
+    }
+
+    // Full-cycle chains save the items played in the current pass, most
+    // recent first, in place of the window.
+    PutInt<uint8_t>(&out, FullCycle());
+    if (FullCycle()) {
+        PutInt<uint32_t>(&out, static_cast<uint32_t>(_pool.size() - _unplayed));
+        for (size_t pos = _unplayed; pos < _pool.size(); pos++) {
+            PutInt<uint64_t>(&out, _keys[_pool[pos]]);
+        }
+    } else {
+        PutInt<uint32_t>(&out, static_cast<uint32_t>(_window.Size()));
+        for (size_t i = 0; i < _window.Size(); i++) {
+            PutInt<uint64_t>(&out, _keys[_window[i]]);
+        }
+    }
+    PutInt<uint64_t>(&out, Fingerprint(out));
+    return out;
+}
+
+std::variant<ShuffleChain::RestoreResult, std::string>
+ShuffleChain::RestoreState(std::string_view state) {
+    if (state.size() < kStateMagic.size() + sizeof(uint64_t) ||
+        state.substr(0, kStateMagic.size()) != kStateMagic) {
+        return "not a shuffle state checkpoint";
+    }
+    std::string_view body = state.substr(0, state.size() - sizeof(uint64_t));
+    BinaryReader reader{state.substr(body.size())};
+    if (reader.Get<uint64_t>() != Fingerprint(body)) {
+        return "shuffle state checkpoint is corrupt";
+    }
+
+    reader = BinaryReader{body.substr(kStateMagic.size())};
+    if (uint32_t version = reader.Get<uint32_t>(); version != kStateVersion) {
+        return absl::StrFormat("unsupported shuffle state version %d",
+                               version);
+    }
+    RestoreResult result;
+    uint64_t items = reader.Get<uint64_t>();
+    uint64_t digest = reader.Get<uint64_t>();
+    result.items_changed = items != _items.size() || digest != KeyDigest();
+
+    std::optional<Xoshiro256::State> rng;
+    if (reader.Get<uint8_t>()) {
+        rng.emplace();
+        for (uint64_t& s : *rng) {
+            s = reader.Get<uint64_t>();
+        }
+    }
+    bool full_cycle = reader.Get<uint8_t>();
+    std::vector<uint64_t> window(reader.Get<uint32_t>());
+    for (uint64_t& key : window) {
+        key = reader.Get<uint64_t>();
+    }
+    if (!reader.ok || !reader.data.empty()) {
+        return "shuffle state checkpoint has the wrong size";
+    }
+
+    if (rng) {
+        _rng->SetState(*rng);
+    }
+    // A checkpoint saved in the other mode holds nothing this chain can use.
+    if (full_cycle != FullCycle()) {
+        return result;
+    }
+    if (FullCycle()) {
+        // Start the pass over, and mark the saved items played again, oldest
+        // first, so the most recent one ends up first, as it was.
+        result.played_saved = window.size();
+        _unplayed = static_cast<uint32_t>(_pool.size());
+        for (auto it = window.rbegin(); it != window.rend(); ++it) {
+            uint32_t idx = _index.Find(*it, _keys);
+            // A well-formed checkpoint never has duplicates.
+            if (idx == internal::KeyIndex::kNotFound ||
+                _pool_pos[idx] >= _unplayed) {
+                continue;
+            }
+            SwapPool(_pool_pos[idx], --_unplayed);
+            StampTags(idx);
+            result.played_restored++;
+        }
+        return result;
+    }
+    // Return the current window to the pool, and rebuild it from the saved
+    // window. The window may have shrunk since the state was saved, so
+    // only restore as many items as fit.
+    result.window_saved = window.size();
+    while (_window.Size() > 0) {
+        ReturnToPool(_window.PopFront());
+    }
+    for (uint64_t key : window) {
+        uint32_t idx = _index.Find(key, _keys);
+        if (idx == internal::KeyIndex::kNotFound ||
+            _window.Size() == _window.Capacity()) {
+            continue;
+        }
+        // A well-formed checkpoint never has duplicates in its window.
+        bool in_pool =
+            _weighted ? _tree.Get(idx) != 0 : _pool_pos[idx] != kInWindow;
+        if (!in_pool) {
+            continue;
+        }
+        TakeFromPool(idx);
+        _window.PushBack(idx);
+        StampTags(idx);
+        result.window_restored++;
+    }
+    return result;
+}
+
+void ShuffleChain::BeginReload() {
+    _reloading = true;
+    _seen.assign(_items.size(), false);
+}
+
+size_t ShuffleChain::EndReload() {
+    assert(_reloading && "EndReload without BeginReload");
+    size_t removed = 0;
+    // Walk backwards, so the items moved into the holes of removed items
+    // have already been checked.
+    for (size_t idx = _items.size(); idx-- > 0;) {
+        if (!_seen[idx]) {
+            RemoveIndex(idx);
+            removed++;
+        }
+    }
+    _reloading = false;
+    _seen.clear();
+    _seen.shrink_to_fit();
+    CollectGarbage();
+    return removed;
+}
+
+void ShuffleChain::SetWeight(size_t index, uint32_t weight) {
+    assert(index < _items.size() && "index out of range");
+    assert(weight >= 1 && "weight must be >= 1");
+    if (!_weighted) {
+        if (weight == 1 || FullCycle()) {
+            return;
+        }
+        EnableWeights();
+    }
+    // Items in the window have no weight in the tree. Their new weight is
+    // added when they return to the pool.
+    if (_tree.Get(index) != 0) {
+        _tree.Add(index, int64_t{weight} - int64_t{_weights[index]});
+    }
+    _weights[index] = weight;
+}
+
+uint32_t ShuffleChain::Weight(size_t index) const {
+    assert(index < _items.size() && "index out of range");
+    return _weighted ? _weights[index] : 1;
+}
+
+void ShuffleChain::EnableWeights() {
+    _weights.assign(_items.size(), 1);
+    std::vector<uint64_t> pool_weights(_items.size(), 0);
+    for (size_t idx : _pool) {
+        pool_weights[idx] = 1;
+    }
+    _tree = FenwickTree(pool_weights);
+    _pool.clear();
+    _pool.shrink_to_fit();
+    _pool_pos.clear();
+    _pool_pos.shrink_to_fit();
+    _weighted = true;
+}
+
+size_t ShuffleChain::Len() const { return _items.size(); }
+size_t ShuffleChain::LenURIs() const { return Slots() - _dead_uris; }
+
+absl::Span<const std::string_view> ShuffleChain::URIs(const Item& item) {
+    if (item.offset >= _uri_ids.size()) {
+        return absl::MakeConstSpan(_uris).subspan(
+            item.offset - _uri_ids.size(), item.length);
+    }
+    // Compaction always compresses every slot, so an item is never split
+    // between _dict and _uris.
+    if (_decoded.size() < item.length) {
+        _decoded.resize(item.length);
+    }
+    if (_decoded_views.size() < item.length) {
+        _decoded_views.resize(item.length);
+    }
+    for (size_t i = 0; i < item.length; i++) {
+        _dict.Get(_uri_ids[item.offset + i], &_decoded[i]);
+        _decoded_views[i] = _decoded[i];
+    }
+    return absl::MakeConstSpan(_decoded_views).subspan(0, item.length);
+}
+
+void ShuffleChain::AppendURIs(const Item& item, size_t* decoded,
+                              std::vector<std::string_view>* out) {
+    if (item.offset >= _uri_ids.size()) {
+        absl::Span<const std::string_view> uris = URIs(item);
+        out->insert(out->end(), uris.begin(), uris.end());
+        return;
+    }
+    if (_decoded.size() < *decoded + item.length) {
+        _decoded.resize(*decoded + item.length);
+    }
+    for (size_t i = 0; i < item.length; i++) {
+        std::string& uri = _decoded[(*decoded)++];
+        _dict.Get(_uri_ids[item.offset + i], &uri);
+        out->push_back(uri);
+    }
+}
+
+void ShuffleChain::Compact() {
+    if (_compression != PoolCompression::kFront ||
+        (_uris.empty() && _dead_uris == 0)) {
+        return;
+    }
+    Repack();
+}
+
+void ShuffleChain::MaybeCompact() {
+    if (_compression == PoolCompression::kFront &&
+        _uris.size() * 8 > Slots()) {
+        Repack();
+    }
+}
+
+void ShuffleChain::CollectGarbage() {
+    // Repacking takes time proportional to the size of the chain, so only
+    // do it once at least half of the slots are dead. This keeps the cost
+    // of updates amortized O(1).
+    if (!_reloading && _dead_uris > 0 && _dead_uris * 2 >= Slots()) {
+        Repack();
+    }
+}
+
+void ShuffleChain::Repack() {
+    // Gather the URIs of every live item, in item order, and renumber the
+    // items to match. URIs that were compressed are decoded into a
+    // temporary arena, so the dictionary can be rebuilt from scratch.
+    StringArena arena;
+    std::vector<std::string_view> slots;
+    slots.reserve(LenURIs());
+    std::string scratch;
+    for (Item& item : _items) {
+        uint32_t offset = static_cast<uint32_t>(slots.size());
+        for (size_t i = 0; i < item.length; i++) {
+            size_t slot = item.offset + i;
+            if (slot < _uri_ids.size()) {
+                _dict.Get(_uri_ids[slot], &scratch);
+                slots.push_back(arena.Append(scratch));
+            } else if (_compression != PoolCompression::kFront) {
+                slots.push_back(arena.Append(_uris[slot - _uri_ids.size()]));
+            } else {
+                // These are compressed below, before _arena is cleared.
+                slots.push_back(_uris[slot - _uri_ids.size()]);
+            }
+        }
+        item.offset = offset;
+    }
+    _dead_uris = 0;
+
+    if (_compression != PoolCompression::kFront) {
+        _uris = std::move(slots);
+        _arena = std::move(arena);
+        return;
+    }
+
+    // Sort the slots by URI, so that the sorted list of unique URIs can be
+    // built, and each slot assigned its id, in a single pass.
+    std::vector<uint32_t> order(slots.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return slots[a] < slots[b]; });
+
+    std::vector<std::string_view> sorted;
+    _uri_ids.resize(slots.size());
+    for (uint32_t slot : order) {
+        if (sorted.empty() || sorted.back() != slots[slot]) {
+            sorted.push_back(slots[slot]);
+        }
+        _uri_ids[slot] = static_cast<uint32_t>(sorted.size() - 1);
+    }
+    _uri_ids.shrink_to_fit();
+    _dict = FrontCodedDict(sorted);
+
+    _uris.clear();
+    _uris.shrink_to_fit();
+    _arena.Clear();
 }
 
 /* ensure that our window is as full as it can possibly be. */
 void ShuffleChain::FillWindow() {
-    while (_window.size() <= _max_window && _pool.size() > 0) {
-        std::uniform_int_distribution<unsigned long long> rd{0,
-                                                             _pool.size() - 1};
-        /* push a random song from the pool onto the end of the window */
-        size_t idx = rd(_rng);
-        _window.push_back(_pool[idx]);
-        _pool.erase(_pool.begin() + idx);
+    if (_weighted) {
+        while (_window.Size() <= _max_window && _tree.Total() > 0) {
+            size_t idx = DrawCandidate(
+                [this] { return _tree.Find(_rng->Bounded64(_tree.Total())); });
+            TakeFromPool(idx);
+            _window.PushBack(idx);
+            StampTags(idx);
+        }
+        return;
+    }
+    while (_window.Size() <= _max_window && _pool.size() > 0) {
+        /* push a random song from the pool onto the end of the window. The
+         * pool never holds more than UINT32_MAX items, since every item has
+         * at least one URI slot. */
+        size_t idx = DrawCandidate([this] {
+            return _pool[_rng->Bounded(static_cast<uint32_t>(_pool.size()))];
+        });
+        TakeFromPool(idx);
+        _window.PushBack(idx);
+        StampTags(idx);
     }
 }
 
-const std::vector<std::string>& ShuffleChain::Pick() {
-    assert(Len() != 0 && "cannot pick from empty chain");
+size_t ShuffleChain::PickIndex() {
+    if (FullCycle()) {
+        return PickCycleIndex();
+    }
     FillWindow();
-    size_t picked_idx = _window[0];
-    _window.pop_front();
-    _pool.push_back(picked_idx);
-    return _items[picked_idx]._uris;
+    size_t picked_idx = _window.PopFront();
+    ReturnToPool(picked_idx);
+    return picked_idx;
 }
 
-std::vector<std::vector<std::string>> ShuffleChain::Items() {
-    std::vector<std::vector<std::string>> result;
-    for (auto group : _items) {
-        result.push_back(group._uris);
+void ShuffleChain::TakeFromPool(size_t idx) {
+    if (_weighted) {
+        _tree.Add(idx, -int64_t{_weights[idx]});
+        return;
+    }
+    uint32_t pos = _pool_pos[idx];
+    if (FullCycle() && pos < _unplayed) {
+        // Keep the unplayed items at the front of the pool.
+        SwapPool(pos, --_unplayed);
+        pos = _unplayed;
+    }
+    SwapPool(pos, static_cast<uint32_t>(_pool.size() - 1));
+    _pool.pop_back();
+    _pool_pos[idx] = kInWindow;
+}
+
+void ShuffleChain::SwapPool(uint32_t a, uint32_t b) {
+    std::swap(_pool[a], _pool[b]);
+    _pool_pos[_pool[a]] = a;
+    _pool_pos[_pool[b]] = b;
+}
+
+size_t ShuffleChain::PickCycleIndex() {
+    uint32_t first = 0;
+    if (_unplayed == 0) {
+        // Start a new pass. The last item of the previous pass is at the
+        // front of the pool, so skip it to avoid playing it twice in a row.
+        _unplayed = static_cast<uint32_t>(_pool.size());
+        first = _unplayed > 1 ? 1 : 0;
+    }
+    size_t idx = DrawCandidate([this, first] {
+        return _pool[first + _rng->Bounded(_unplayed - first)];
+    });
+    // One Fisher-Yates step: move the picked item to the end of the
+    // unplayed items, and shrink them by one.
+    SwapPool(_pool_pos[idx], --_unplayed);
+    StampTags(idx);
+    return idx;
+}
+
+void ShuffleChain::ReturnToPool(size_t idx) {
+    if (_weighted) {
+        _tree.Add(idx, _weights[idx]);
+    } else {
+        _pool_pos[idx] = static_cast<uint32_t>(_pool.size());
+        _pool.push_back(static_cast<uint32_t>(idx));
+    }
+}
+
+absl::Span<const std::string_view> ShuffleChain::Pick() {
+    assert(Len() != 0 && "cannot pick from empty chain");
+    MaybeCompact();
+    return URIs(_items[PickIndex()]);
+}
+
+void ShuffleChain::PickN(size_t n, std::vector<std::string_view>* out) {
+    PickInto(n, 0, out);
+}
+
+void ShuffleChain::PickURIs(size_t n, std::vector<std::string_view>* out) {
+    PickInto(0, n, out);
+}
+
+void ShuffleChain::PickInto(size_t min_items, size_t min_uris,
+                            std::vector<std::string_view>* out) {
+    out->clear();
+    if (min_items == 0 && min_uris == 0) {
+        return;
+    }
+    assert(Len() != 0 && "cannot pick from empty chain");
+    MaybeCompact();
+
+    size_t decoded = 0;
+    for (size_t items = 0; items < min_items || out->size() < min_uris;
+         items++) {
+        AppendURIs(_items[PickIndex()], &decoded, out);
     }
-    return result;
 }
 
 }  // namespace ashuffle
@@ -1,72 +1,623 @@
 #ifndef __ASHUFFLE_SHUFFLE_H__
 #define __ASHUFFLE_SHUFFLE_H__
 
+#include <cassert>
+#include <cstdint>
 #include <deque>
-#include <random>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
+#include <absl/types/span.h>
+
+#include "arena.h"
+#include "fenwick.h"
+#include "front_coded.h"
+#include "random.h"
+
 namespace ashuffle {
 
 class ShuffleChain;
 
+// ShuffleItem describes an item (a single URI, or a group of URIs) to be
+// added to a ShuffleChain. It does not own the URIs it refers to, they are
+// copied into the chain by `ShuffleChain::Add`, so a ShuffleItem must not
+// outlive the strings it was built from.
+//
+// Every item has a key, which identifies it within a chain. The key of a
+// single URI is its Fingerprint. Groups can be given an explicit key (e.g.,
+// derived from the tags they are grouped by), so that they keep their
+// identity when their URIs change. Otherwise, the key of a group is derived
+// from all of its URIs.
 class ShuffleItem {
    public:
-    template <typename T>
-    ShuffleItem(T v) : ShuffleItem(std::vector<std::string>{v}){};
-    ShuffleItem(std::vector<std::string> uris) : _uris(uris){};
+    ShuffleItem(const char* uri) : ShuffleItem(std::string_view(uri)){};
+    ShuffleItem(const std::string& uri) : ShuffleItem(std::string_view(uri)){};
+    ShuffleItem(std::string_view uri) : _single(uri){};
+    // The key of a single URI may be given, if its fingerprint is already
+    // known, so that the URI is not hashed again.
+    ShuffleItem(std::string_view uri, uint64_t key)
+        : _single(uri), _key(key){};
+    ShuffleItem(const std::vector<std::string>& uris) : _group(&uris){};
+    ShuffleItem(const std::vector<std::string>& uris, uint64_t key)
+        : _group(&uris), _key(key){};
+
+    // Returns the key of this item.
+    uint64_t Key() const;
+
+    // Returns a copy of this item with the given tags (e.g., the artist of
+    // the item's songs). Chains with a tag cooldown (see
+    // ShuffleChain::SetTagCooldown) avoid picking items that share a tag
+    // soon after one another. Like its URIs, the item does not own its tags.
+    ShuffleItem WithTags(const std::vector<std::string>& tags) const {
+        ShuffleItem tagged = *this;
+        tagged._tags = &tags;
+        return tagged;
+    }
 
    private:
-    std::vector<std::string> _uris;
+    size_t Size() const { return _group ? _group->size() : 1; }
+    size_t TagCount() const { return _tags ? _tags->size() : 0; }
+    std::string_view URI(size_t i) const {
+        return _group ? std::string_view((*_group)[i]) : _single;
+    }
+
+    std::string_view _single;
+    const std::vector<std::string>* _group = nullptr;
+    std::optional<uint64_t> _key;
+    const std::vector<std::string>* _tags = nullptr;
     friend class ShuffleChain;
+    friend class ShuffleFeed;
+};
+
+namespace internal {
+
+// Ring is a FIFO queue backed by a single contiguous buffer. Pushing and
+// popping never allocate, storage is only (re-)allocated by `Reserve`. It is
+// an error to push more items than the reserved capacity.
+template <typename T>
+class Ring {
+   public:
+    size_t Size() const { return size_; }
+    size_t Capacity() const { return buf_.size(); }
+
+    // Grow the capacity of this ring to at least `cap` items. The order of
+    // items currently in the ring is preserved.
+    void Reserve(size_t cap) {
+        if (cap <= buf_.size()) {
+            return;
+        }
+        std::vector<T> grown(cap);
+        for (size_t i = 0; i < size_; i++) {
+            grown[i] = (*this)[i];
+        }
+        buf_ = std::move(grown);
+        head_ = 0;
+    }
+
+    void PushBack(T v) {
+        assert(size_ < buf_.size() && "push onto full ring");
+        buf_[Wrap(head_ + size_)] = v;
+        size_++;
+    }
+
+    T PopFront() {
+        assert(size_ > 0 && "pop from empty ring");
+        T v = buf_[head_];
+        head_ = Wrap(head_ + 1);
+        size_--;
+        return v;
+    }
+
+    // Returns the i'th item from the front of the ring.
+    const T& operator[](size_t i) const { return buf_[Wrap(head_ + i)]; }
+    T& operator[](size_t i) { return buf_[Wrap(head_ + i)]; }
+
+    // Remove the i'th item from the front of the ring, preserving the order
+    // of the remaining items. Takes time linear in the size of the ring.
+    void Erase(size_t i) {
+        assert(i < size_ && "erase past end of ring");
+        for (; i + 1 < size_; i++) {
+            (*this)[i] = (*this)[i + 1];
+        }
+        size_--;
+    }
+
+    // Remove all items from the ring, and release its storage.
+    void Clear() {
+        buf_.clear();
+        head_ = 0;
+        size_ = 0;
+    }
+
+   private:
+    // Indices passed to Wrap are always < 2 * capacity, so a single
+    // subtraction is cheaper than a modulo.
+    size_t Wrap(size_t i) const {
+        return i >= buf_.size() ? i - buf_.size() : i;
+    }
+
+    std::vector<T> buf_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+// KeyIndex maps item keys to item indices, using an open-addressing hash
+// table with linear probing. The table only stores item indices: keys are
+// read from the chain's vector of item keys, which is passed to every call.
+// This keeps the index at a few bytes per item.
+class KeyIndex {
+   public:
+    static constexpr uint32_t kNotFound = UINT32_MAX;
+
+    // Returns the index of the item with the given key, or kNotFound.
+    uint32_t Find(uint64_t key, const std::vector<uint64_t>& keys) const;
+
+    // Add item `idx`, whose key is `keys[idx]`. The key must not already be
+    // in the index.
+    void Insert(uint32_t idx, const std::vector<uint64_t>& keys);
+
+    // Remove item `idx` from the index.
+    void Erase(uint32_t idx, const std::vector<uint64_t>& keys);
+
+    // Replace item `from` with item `to`, which must have the same key.
+    void Move(uint32_t from, uint32_t to, const std::vector<uint64_t>& keys);
+
+    void Clear();
+
+   private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    // Returns the slot holding item `idx`.
+    size_t SlotOf(uint32_t idx, const std::vector<uint64_t>& keys) const;
+    void Grow(const std::vector<uint64_t>& keys);
+
+    // Keys are fingerprints, which are already well mixed, so the home slot
+    // of a key is just its low bits.
+    size_t Home(uint64_t key) const { return key & (slots_.size() - 1); }
+
+    // The number of slots is always zero, or a power of two.
+    std::vector<uint32_t> slots_;
+    size_t size_ = 0;
+};
+
+// RNG is the interface ShuffleChain uses to draw random numbers. It erases
+// the type of the underlying generator, so that ShuffleChain can use any
+// UniformRandomBitGenerator without itself being a template.
+class RNG {
+   public:
+    virtual ~RNG() = default;
+
+    // Returns a uniformly distributed integer in [0, range).
+    virtual uint32_t Bounded(uint32_t range) = 0;
+    virtual uint64_t Bounded64(uint64_t range) = 0;
+
+    // Returns the state of the generator, if it is a Xoshiro256. The state
+    // of other generators cannot be saved.
+    virtual std::optional<Xoshiro256::State> GetState() const = 0;
+
+    // Restore the given state. Returns false if the generator is not a
+    // Xoshiro256.
+    virtual bool SetState(const Xoshiro256::State& state) = 0;
+};
+
+template <typename URBG>
+class RNGImpl : public RNG {
+   public:
+    explicit RNGImpl(URBG g) : g_(std::move(g)){};
+
+    uint32_t Bounded(uint32_t range) override {
+        return ashuffle::Bounded(g_, range);
+    }
+
+    uint64_t Bounded64(uint64_t range) override {
+        return ashuffle::Bounded64(g_, range);
+    }
+
+    std::optional<Xoshiro256::State> GetState() const override {
+        if constexpr (std::is_same_v<URBG, Xoshiro256>) {
+            return g_.GetState();
+        }
+        return std::nullopt;
+    }
+
+    bool SetState([[maybe_unused]] const Xoshiro256::State& state) override {
+        if constexpr (std::is_same_v<URBG, Xoshiro256>) {
+            g_ = Xoshiro256(state);
+            return true;
+        }
+        return false;
+    }
+
+   private:
+    URBG g_;
+};
+
+// IsURBG is true when T looks like a UniformRandomBitGenerator.
+template <typename T, typename = void>
+struct IsURBG : std::false_type {};
+
+template <typename T>
+struct IsURBG<T, std::void_t<typename T::result_type,
+                             decltype(std::declval<T&>()())>>
+    : std::true_type {};
+
+}  // namespace internal
+
+// PoolCompression selects how a ShuffleChain stores the URIs in its pool.
+enum class PoolCompression {
+    // URIs are stored as-is, and picks return views directly into the pool.
+    kNone,
+    // URIs are sorted and front-coded (see FrontCodedDict), and decoded when
+    // they are picked. Saves most of the memory used to store URIs, at the
+    // cost of slightly slower picks.
+    kFront,
 };
 
 class ShuffleChain {
    public:
+    // Passing kFullCycle as the window size selects full-cycle mode. Rather
+    // than avoiding repeats within a fixed window, a full-cycle chain picks
+    // every item once, in random order, before picking any item again. Each
+    // pass starts with a new random order. Picks take O(1) time. The
+    // permutation, and each item's position in it (so that items can be
+    // removed, or re-added by a reload, in O(1) time), take 8 bytes per
+    // item. Every item is picked once per
+    // pass, so the weights given to Add and SetWeight are ignored.
+    static constexpr size_t kFullCycle = SIZE_MAX;
+
     // By default, create a new shuffle chain with a window-size of 1.
     ShuffleChain() : ShuffleChain(1){};
 
     // Create a new ShuffleChain with the given window length.
-    explicit ShuffleChain(size_t window) : _max_window(window) {
-        std::random_device rd;
-        _rng.seed(rd());
-    }
+    explicit ShuffleChain(size_t window)
+        : ShuffleChain(window, PoolCompression::kNone) {}
+
+    // Create a new ShuffleChain with the given window length, storing URIs
+    // using the given compression. The chain uses a Xoshiro256 generator
+    // seeded from std::random_device.
+    ShuffleChain(size_t window, PoolCompression compression)
+        : ShuffleChain(window, compression, Xoshiro256(RandomSeed())) {}
+
+    // Create a new ShuffleChain with the given window length, using the
+    // given UniformRandomBitGenerator (e.g., Xoshiro256, or std::mt19937).
+    template <typename URBG,
+              typename = std::enable_if_t<internal::IsURBG<URBG>::value>>
+    ShuffleChain(size_t window, URBG rng)
+        : ShuffleChain(window, PoolCompression::kNone, std::move(rng)) {}
 
-    // Create a new ShuffleChain with the given window length
-    // and using the given RandomNumberEngine
-    ShuffleChain(size_t window, std::mt19937 rng)
-        : _max_window(window), _rng(rng) {}
+    // Create a new ShuffleChain with the given window length, compression,
+    // and UniformRandomBitGenerator.
+    template <typename URBG,
+              typename = std::enable_if_t<internal::IsURBG<URBG>::value>>
+    ShuffleChain(size_t window, PoolCompression compression, URBG rng)
+        : _max_window(window),
+          _compression(compression),
+          _rng(std::make_unique<internal::RNGImpl<URBG>>(std::move(rng))) {}
 
     // Clear this shuffle chain, removing anypreviously added songs.
     void Clear();
 
     // Add a string to the pool of songs that can be picked out of this
-    // chain.
+    // chain. If the chain already holds an item with the same key (see
+    // ShuffleItem), that item is updated in place instead: its URIs are
+    // replaced, and it keeps its weight, and its place in the window or
+    // pool. Updating an item takes O(1) time, plus the size of the item.
     void Add(ShuffleItem i);
 
-    // Return the total number of Items (groups) in this chain.
-    size_t Len();
+    // Add (or update) an item with the given weight. Outside of the window,
+    // items are picked in proportion to their weight, so an item with weight
+    // 2 is picked twice as often as one with weight 1. Weights must be >= 1,
+    // and items added without a weight have a weight of 1.
+    //
+    // While every item has a weight of 1, the chain draws from its pool in
+    // O(1). Once any item is given a different weight, the chain switches
+    // to a weighted pool, where draws, and weight updates, take O(log n).
+    void Add(ShuffleItem i, uint32_t weight);
+
+    // Set the weight of the item at `index`. Items are indexed in the order
+    // they were added (which is also the order used by ForEach), except that
+    // removing an item moves the last item into its index.
+    // If the item is currently in the window, the new weight is used once it
+    // returns to the pool. O(log n). In full-cycle mode (see kFullCycle),
+    // weights are ignored, and this does nothing.
+    void SetWeight(size_t index, uint32_t weight);
+
+    // Returns the weight of the item at `index`.
+    uint32_t Weight(size_t index) const;
+
+    // The maximum number of candidates drawn for each pick when a tag
+    // cooldown is set.
+    static constexpr int kCooldownDraws = 8;
+
+    // Set the tag cooldown of this chain. With a cooldown of `picks`, the
+    // chain avoids picking an item that shares a tag (see
+    // ShuffleItem::WithTags) with any of the `picks` items picked before
+    // it. Candidates are drawn from the pool until one has no recently used
+    // tags, up to kCooldownDraws times, and the candidate whose tags were
+    // used least recently is taken. So picks still take O(1) time, even
+    // when one tag dominates the chain, at the cost of occasionally
+    // breaking the cooldown. Tags are only stored while the cooldown is
+    // non-zero, so it should be set before items are added. A cooldown of
+    // 0, the default, turns this off.
+    void SetTagCooldown(size_t picks);
+
+    // Remove the item with the given key from this chain, whether it is in
+    // the pool or the window. The rest of the window is left intact. To
+    // keep indices dense, the last item in the chain takes the index of the
+    // removed item. Returns false if there was no such item. Takes O(1)
+    // time, plus the size of the window.
+    bool Remove(uint64_t key);
+
+    // Remove the single-URI item with the given URI. Equivalent to
+    // Remove(Fingerprint(uri)).
+    bool Remove(std::string_view uri);
+
+    // BeginReload and EndReload bracket a reload of the whole chain, e.g.,
+    // after the music library changes: every item that is not added between
+    // the two calls is removed by EndReload. Items that are re-added are
+    // updated in place, so unlike Clear, a reload keeps the window, and the
+    // weights of items that did not change. EndReload returns the number of
+    // items removed.
+    void BeginReload();
+    size_t EndReload();
+
+    // Return the total number of Items (groups) in this chain. O(1).
+    size_t Len() const;
+
+    // Return the total number of URIs in this chain, in all items. O(1).
+    size_t LenURIs() const;
+
+    // Pick a group of songs out of this chain. Picking takes amortized O(1)
+    // time, or O(log n) once any item has a weight (see SetWeight). The
+    // returned URIs point into storage owned by the chain, and remain valid
+    // until the chain is cleared or destroyed, or items are added, updated,
+    // or removed (which may grow or repack the chain's storage). So they
+    // must be used before any more items are loaded into the chain (e.g., by
+    // BackgroundLoad::Drain). When the pool is compressed, the URIs are
+    // decoded into a buffer that is re-used, and they are only valid until
+    // the next call to Pick, PickN, or PickURIs.
+    // Decoding front-coded URIs (see PoolCompression::kFront) may allocate.
+    absl::Span<const std::string_view> Pick();
+
+    // PickN picks `n` items out of this chain, exactly as if Pick was called
+    // `n` times, and stores the URIs of all picked items, in pick order, in
+    // `out`. `out` is cleared first. Its storage, and the chain's buffers for
+    // decoding compressed URIs, are re-used between calls, so they usually
+    // only allocate until they have grown large enough. Like Pick, each pick
+    // takes amortized O(1) time, or O(log n) with weights. The URIs in `out`
+    // follow the same lifetime rules as those returned by Pick.
+    void PickN(size_t n, std::vector<std::string_view>* out);
+
+    // PickURIs is like PickN, but picks items until at least `n` URIs have
+    // been picked. When items are groups, more than `n` URIs may be picked.
+    void PickURIs(size_t n, std::vector<std::string_view>* out);
+
+    // RestoreResult describes the outcome of RestoreState.
+    struct RestoreResult {
+        // The number of items in the saved window, and the number of those
+        // that were still in the chain, and were restored.
+        size_t window_saved = 0;
+        size_t window_restored = 0;
+        // For full-cycle chains, which have no window: the number of items
+        // played in the saved pass, and the number of those that were
+        // restored, and won't be played again in the pass.
+        size_t played_saved = 0;
+        size_t played_restored = 0;
+        // True if the items in the chain differ from the items in the chain
+        // the state was saved from (e.g., because the library changed).
+        bool items_changed = false;
+    };
 
-    // Return the total number of URIs in this chain, in all items.
-    size_t LenURIs();
+    // SaveState returns a compact binary checkpoint of the parts of this
+    // chain that cannot be rebuilt by reloading it: the keys of the items in
+    // the window, in order, and the state of the random number generator
+    // (only if it is a Xoshiro256). The size of the checkpoint depends only
+    // on the size of the window, not the size of the chain. Full-cycle
+    // chains save the keys of the items played in the current pass instead,
+    // so their checkpoints take up to 8 bytes per item.
+    std::string SaveState() const;
 
-    // Pick a group of songs out of this chain.
-    const std::vector<std::string>& Pick();
+    // RestoreState restores a checkpoint made by SaveState into this chain,
+    // which should already hold its items. Saved window items that are
+    // still in the chain are moved into the window, in order, so the songs
+    // that were about to be picked are picked next, and recently picked
+    // songs are not repeated. Saved window items that are no longer in the
+    // chain are skipped. The order of the pool is not saved, so later picks
+    // differ from those the saved chain would have made. Full-cycle chains
+    // continue the saved pass: the saved items still in the chain are not
+    // picked again until the unplayed ones have been. Checkpoints saved by
+    // a chain in the other mode only restore the random number generator.
+    // Takes O(n) time, with a small constant, to compare the chain's items
+    // with the saved ones. Returns an error message if the checkpoint is
+    // malformed.
+    std::variant<RestoreResult, std::string> RestoreState(
+        std::string_view state);
 
-    // Items returns a vector of all items in this chain. This operation is
-    // extremely heavyweight, since it copies most of the storage used by
-    // the chain. Use with caution.
-    std::vector<std::vector<std::string>> Items();
+    // Compress any URIs added since the last compaction. This is a no-op
+    // unless the chain uses PoolCompression::kFront. Compaction happens
+    // automatically on Pick once uncompressed URIs make up more than an
+    // eighth of the chain (the pick then takes time proportional to the size
+    // of the chain), so small updates do not recompress everything. Callers
+    // can use Compact to release uncompressed storage eagerly, e.g., right
+    // after loading.
+    void Compact();
+
+    // ForEach calls `f` with the URIs of every item in this chain, in index
+    // order (see SetWeight), as an `absl::Span<const std::string_view>`.
+    // Items are visited in place, without copying the chain. The URIs are
+    // only valid for the duration of each call to `f`.
+    template <typename F>
+    void ForEach(F&& f) {
+        for (const Item& item : _items) {
+            f(URIs(item));
+        }
+    }
 
    private:
+    // Item is the range of URI slots that make up a single item. Slots
+    // below `_uri_ids.size()` are compressed, and later slots are stored in
+    // `_uris`.
+    struct Item {
+        uint32_t offset;
+        uint32_t length;
+    };
+
     void FillWindow();
 
+    // Insert a new item, or update the existing item with the same key.
+    // Updated items keep their weight unless `weight` is given.
+    void Upsert(ShuffleItem item, std::optional<uint32_t> weight);
+
+    // Remove the item at index `idx`, moving the last item into its place.
+    void RemoveIndex(size_t idx);
+
+    // Returns the number of URI slots in use, including dead slots of
+    // removed, or updated, items.
+    size_t Slots() const { return _uri_ids.size() + _uris.size(); }
+
+    // Append the URIs of `item` to the URI storage, returning the new item.
+    Item StoreURIs(ShuffleItem item);
+
+    // Repack the URI storage once most of it is dead.
+    void CollectGarbage();
+
+    // Rewrite the URI storage so it only holds the URIs of live items, in
+    // item order. With PoolCompression::kFront, all URIs are compressed.
+    void Repack();
+
+    // Compress the chain if enough of it is uncompressed (see Compact).
+    void MaybeCompact();
+
+    // Append the URIs of `item` to `out`. Compressed URIs are decoded into
+    // `_decoded`, starting at index `*decoded`, which is advanced past them.
+    void AppendURIs(const Item& item, size_t* decoded,
+                    std::vector<std::string_view>* out);
+
+    // Switch this chain to a weighted pool, with all items at weight 1.
+    void EnableWeights();
+
+    // TagRange is the range of _tag_ids that holds the tags of an item.
+    struct TagRange {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // Store the tags of `item` as the tags of the item at index `idx`,
+    // which may be one past the last item.
+    void StoreTags(size_t idx, ShuffleItem item);
+
+    // Rewrite _tag_ids so it only holds the tags of live items.
+    void RepackTags();
+
+    // Returns the most recent stamp of any tag of the given item, or 0 if
+    // none of its tags were used.
+    uint64_t TagStamp(size_t idx) const;
+
+    // Mark the tags of the given item as used by the next pick.
+    void StampTags(size_t idx);
+
+    // Draw candidate items with `draw` until one is not cooling down (see
+    // SetTagCooldown), and return the best candidate.
+    template <typename Draw>
+    size_t DrawCandidate(Draw draw);
+
+    // Return the given item to the pool.
+    void ReturnToPool(size_t idx);
+
+    // Take the given item, which must be in the pool, out of the pool.
+    void TakeFromPool(size_t idx);
+
+    bool FullCycle() const { return _max_window == kFullCycle; }
+
+    // Pick the next item of the current pass, in full-cycle mode.
+    size_t PickCycleIndex();
+
+    // Swap the items at the given positions in _pool.
+    void SwapPool(uint32_t a, uint32_t b);
+
+    // Returns a digest of the keys of all items in this chain, which does
+    // not depend on the order of the items.
+    uint64_t KeyDigest() const;
+
+    // Pick the index of the next item, and return it to the pool.
+    size_t PickIndex();
+
+    // Shared implementation of PickN and PickURIs. Picks items until at
+    // least `min_items` items, and `min_uris` URIs have been picked.
+    void PickInto(size_t min_items, size_t min_uris,
+                  std::vector<std::string_view>* out);
+
+    // Returns the URIs of the given item. Compressed URIs are decoded into
+    // `_decoded`.
+    absl::Span<const std::string_view> URIs(const Item& item);
+
     size_t _max_window;
-    std::vector<ShuffleItem> _items;
-    std::deque<size_t> _window;
-    std::deque<size_t> _pool;
-    std::mt19937 _rng;
+    PoolCompression _compression;
+    // Uncompressed URI strings are stored in _arena. _uris holds views of
+    // those strings, with the URIs of each item stored contiguously, in order.
+    StringArena _arena;
+    std::vector<std::string_view> _uris;
+    // Compressed URIs are stored in _dict, and _uri_ids maps each compressed
+    // slot to its id in _dict.
+    FrontCodedDict _dict;
+    std::vector<uint32_t> _uri_ids;
+    // The number of slots that belong to removed, or updated, items.
+    size_t _dead_uris = 0;
+    // Scratch space for URIs decoded from _dict. A deque never moves its
+    // elements when it grows, so views of decoded URIs stay valid while
+    // more URIs are decoded.
+    std::deque<std::string> _decoded;
+    std::vector<std::string_view> _decoded_views;
+    std::vector<Item> _items;
+    // _keys holds the key of every item, and _index maps keys back to items.
+    std::vector<uint64_t> _keys;
+    internal::KeyIndex _index;
+    // While reloading, _seen marks the items that have been re-added.
+    bool _reloading = false;
+    std::vector<bool> _seen;
+    // _window holds the indices of the items that will be picked next, in
+    // order. It is sized to hold up to _max_window + 1 items, but never more
+    // items than are in the chain.
+    internal::Ring<size_t> _window;
+    // _pool holds the indices of all items not in the window. Its order is
+    // not meaningful: items are drawn by swapping a random index with the
+    // last one, and popping it off. _pool_pos holds the position of each
+    // item in _pool, or kInWindow. Both are unused in weighted mode.
+    //
+    // In full-cycle mode, the window is unused, and _pool holds every item.
+    // It is an incrementally built Fisher-Yates permutation: the first
+    // _unplayed items have not been picked in the current pass, and the
+    // rest are the items picked so far, most recent first.
+    std::vector<uint32_t> _pool;
+    uint32_t _unplayed = 0;
+    static constexpr uint32_t kInWindow = UINT32_MAX;
+    std::vector<uint32_t> _pool_pos;
+    // In weighted mode, _weights holds the weight of every item, and _tree
+    // holds the weights of the items in the pool, indexed by item. Items in
+    // the window have a weight of zero in _tree, so they are never drawn.
+    bool _weighted = false;
+    std::vector<uint32_t> _weights;
+    FenwickTree _tree;
+    // With a tag cooldown, tags are interned into _tag_dict, and the tags of
+    // each item are stored in _item_tags ranges of _tag_ids. Every pick (or
+    // push onto the window, which fixes the pick order) gets the next stamp,
+    // and _tag_stamps holds the stamp of the last pick that used each tag.
+    size_t _cooldown = 0;
+    std::unordered_map<std::string, uint32_t> _tag_dict;
+    std::vector<uint64_t> _tag_stamps;
+    uint64_t _next_stamp = 1;
+    std::vector<TagRange> _item_tags;
+    std::vector<uint32_t> _tag_ids;
+    size_t _dead_tags = 0;
+    std::vector<uint32_t> _tag_scratch;
+    std::unique_ptr<internal::RNG> _rng;
 };
 
 }  // namespace ashuffle
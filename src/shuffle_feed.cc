@@ -0,0 +1,91 @@
+#include "shuffle_feed.h"
+
+#include <utility>
+
+namespace ashuffle {
+
+void ShuffleFeed::Add(const ShuffleItem& item) {
+    for (size_t i = 0; i < item.Size(); i++) {
+        batch_.uris.emplace_back(item.URI(i));
+    }
+    for (size_t i = 0; i < item.TagCount(); i++) {
+        batch_.tags.push_back((*item._tags)[i]);
+    }
+    // Items are re-added with their key, so that items given an explicit
+    // key keep it, and the others are hashed by the producer, rather than
+    // when they are drained.
+    batch_.entries.push_back(Entry{static_cast<uint32_t>(item.Size()),
+                                   static_cast<uint32_t>(item.TagCount()),
+                                   item._group != nullptr, item.Key()});
+    if (batch_.entries.size() >= batch_size_) {
+        Publish(false);
+    }
+}
+
+void ShuffleFeed::Flush() { Publish(false); }
+
+void ShuffleFeed::Close() { Publish(true); }
+
+void ShuffleFeed::Publish(bool close) {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (!batch_.entries.empty()) {
+            published_.push_back(std::move(batch_));
+        }
+        closed_ = closed_ || close;
+    }
+    ready_.notify_one();
+    batch_ = Batch();
+}
+
+void ShuffleFeed::Wait() {
+    std::unique_lock<std::mutex> lock(mu_);
+    ready_.wait(lock, [this] { return !published_.empty() || closed_; });
+}
+
+void ShuffleFeed::WaitUntil(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(mu_);
+    ready_.wait_until(lock, deadline,
+                      [this] { return !published_.empty() || closed_; });
+}
+
+size_t ShuffleFeed::Drain() {
+    bool closed;
+    {
+        std::unique_lock<std::mutex> lock(mu_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return 0;
+        }
+        draining_.swap(published_);
+        closed = closed_;
+    }
+
+    size_t added = 0;
+    std::vector<std::string> group;
+    std::vector<std::string> tags;
+    for (Batch& batch : draining_) {
+        auto uri = batch.uris.begin();
+        auto tag = batch.tags.begin();
+        for (const Entry& entry : batch.entries) {
+            tags.assign(std::make_move_iterator(tag),
+                        std::make_move_iterator(tag + entry.tags));
+            tag += entry.tags;
+            if (!entry.group) {
+                chain_->Add(ShuffleItem(*uri++, entry.key).WithTags(tags));
+            } else {
+                group.assign(std::make_move_iterator(uri),
+                             std::make_move_iterator(uri + entry.size));
+                uri += entry.size;
+                chain_->Add(ShuffleItem(group, entry.key).WithTags(tags));
+            }
+        }
+        added += batch.entries.size();
+    }
+    draining_.clear();
+    // Nothing is published after the feed is closed, so if it was closed
+    // before the swap, every item has now been added.
+    done_ = closed;
+    return added;
+}
+
+}  // namespace ashuffle
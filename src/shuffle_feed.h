@@ -0,0 +1,105 @@
+#ifndef __ASHUFFLE_SHUFFLE_FEED_H__
+#define __ASHUFFLE_SHUFFLE_FEED_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "shuffle.h"
+
+namespace ashuffle {
+
+// ShuffleFeed lets a producer thread (e.g., a loader reading the library)
+// add items to a ShuffleChain while a consumer thread picks from it.
+//
+// The chain is only ever touched by the consumer. The producer copies items
+// into a private batch, and publishes each full batch to a shared queue,
+// holding the lock only long enough to move the batch. The consumer moves
+// published batches into the chain with `Drain`, which only try-locks, so
+// picking never waits on the producer.
+class ShuffleFeed {
+   public:
+    // The number of items the producer collects before publishing them.
+    static constexpr size_t kDefaultBatchSize = 1024;
+
+    explicit ShuffleFeed(ShuffleChain* chain)
+        : ShuffleFeed(chain, kDefaultBatchSize){};
+    ShuffleFeed(ShuffleChain* chain, size_t batch_size)
+        : chain_(chain), batch_size_(batch_size){};
+
+    // Producer interface. These methods must only be called from a single
+    // thread.
+
+    // Add the given item to the chain. The item's URIs and tags are copied,
+    // so the item need not outlive this call.
+    void Add(const ShuffleItem& item);
+
+    // Publish the items added so far, even if the current batch is not full.
+    void Flush();
+
+    // Publish any remaining items, and mark the feed as complete. No items
+    // may be added after the feed is closed.
+    void Close();
+
+    // Consumer interface. These methods must only be called from the thread
+    // that owns the chain.
+
+    // Add all published items to the chain, and return the number of items
+    // added. Returns 0, without waiting, if the producer is publishing a
+    // batch.
+    size_t Drain();
+
+    // Returns true once the feed is closed, and all of its items have been
+    // added to the chain.
+    bool Done() const { return done_; }
+
+    // Wait until there are published items to drain, or the feed is closed.
+    // Unlike Drain, these block on the producer, so they should only be used
+    // when the consumer has nothing else to do (e.g., while the chain is
+    // still empty). WaitUntil gives up once the deadline has passed.
+    void Wait();
+    void WaitUntil(std::chrono::steady_clock::time_point deadline);
+
+   private:
+    struct Entry {
+        uint32_t size;
+        uint32_t tags;
+        bool group;
+        uint64_t key;
+    };
+
+    // Batch holds items in a flat form: the URIs of all items are stored
+    // back to back in `uris`, and `entries[i].size` of them belong to the
+    // i'th item. Tags are stored the same way.
+    struct Batch {
+        std::vector<std::string> uris;
+        std::vector<std::string> tags;
+        std::vector<Entry> entries;
+    };
+
+    void Publish(bool close);
+
+    ShuffleChain* const chain_;
+    const size_t batch_size_;
+
+    // Owned by the producer.
+    Batch batch_;
+
+    // Guarded by mu_. ready_ is notified whenever a batch is published, or
+    // the feed is closed.
+    std::mutex mu_;
+    std::condition_variable ready_;
+    std::vector<Batch> published_;
+    bool closed_ = false;
+
+    // Owned by the consumer.
+    std::vector<Batch> draining_;
+    bool done_ = false;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_SHUFFLE_FEED_H__
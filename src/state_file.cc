@@ -0,0 +1,61 @@
+#include "state_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <absl/strings/str_format.h>
+
+#include "binary_file.h"
+
+namespace ashuffle {
+
+std::variant<ShuffleChain::RestoreResult, std::string> StateFile::Restore(
+    ShuffleChain* chain) {
+    int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        return ShuffleChain::RestoreResult{};
+    }
+    if (fd < 0) {
+        return ErrnoMessage("failed to open state file", path_);
+    }
+    std::string data;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            std::string err = ErrnoMessage("failed to read state file", path_);
+            close(fd);
+            return err;
+        }
+        data.append(buf, n);
+    }
+    close(fd);
+
+    auto result = chain->RestoreState(data);
+    if (std::string* err = std::get_if<std::string>(&result); err != nullptr) {
+        return absl::StrFormat("state file '%s': %s", path_, *err);
+    }
+    last_ = std::move(data);
+    return result;
+}
+
+std::optional<std::string> StateFile::Save(const ShuffleChain& chain) {
+    std::string data = chain.SaveState();
+    if (data == last_) {
+        return std::nullopt;
+    }
+
+    if (std::optional<std::string> err =
+            WriteFileAtomic(path_, "state file", {data});
+        err) {
+        return err;
+    }
+    last_ = std::move(data);
+    return std::nullopt;
+}
+
+}  // namespace ashuffle
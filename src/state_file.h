@@ -0,0 +1,40 @@
+#ifndef __ASHUFFLE_STATE_FILE_H__
+#define __ASHUFFLE_STATE_FILE_H__
+
+#include <optional>
+#include <string>
+#include <variant>
+
+#include "shuffle.h"
+
+namespace ashuffle {
+
+// StateFile persists the state of a ShuffleChain (see
+// ShuffleChain::SaveState) to a file, so that ashuffle can continue where it
+// left off after a restart.
+class StateFile {
+   public:
+    explicit StateFile(std::string path) : path_(std::move(path)){};
+
+    // Restore the state of the given chain from this file. A missing file is
+    // not an error: the chain is left as-is, and an empty result is
+    // returned. Returns an error message on failure.
+    std::variant<ShuffleChain::RestoreResult, std::string> Restore(
+        ShuffleChain* chain);
+
+    // Save the state of the given chain to this file, if it changed since
+    // the last Save or Restore. The file is replaced atomically: the state
+    // is written to a temporary file in the same directory, synced, and
+    // renamed over the state file, so a crash never leaves a partially
+    // written state file behind. Returns an error message on failure.
+    std::optional<std::string> Save(const ShuffleChain& chain);
+
+   private:
+    std::string path_;
+    // The contents of the file as of the last Save or Restore.
+    std::string last_;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_STATE_FILE_H__
@@ -0,0 +1,252 @@
+#include "uri_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "fingerprint.h"
+
+namespace ashuffle {
+
+namespace {
+
+// Files that can not be mapped are read in blocks of this size.
+constexpr size_t kReadBlockSize = 1024 * 1024;
+
+// Files are only split on several threads in chunks of at least this size,
+// since smaller chunks are split faster than a thread is started.
+constexpr size_t kMinChunkSize = 4 * 1024 * 1024;
+
+// The lines of one chunk of a file, and their fingerprints.
+struct Chunk {
+    std::vector<std::string_view> lines;
+    std::vector<uint64_t> keys;
+};
+
+void SplitLines(std::string_view data, Chunk* chunk) {
+    while (!data.empty()) {
+        size_t end = data.find('\n');
+        std::string_view line = data.substr(0, end);
+        data.remove_prefix(end == std::string_view::npos ? data.size()
+                                                         : end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        chunk->lines.push_back(line);
+        chunk->keys.push_back(Fingerprint(line));
+    }
+}
+
+// Read up to `size` bytes from `fd` into `buf`, stopping early only at the
+// end of the file, or on an error.
+size_t ReadFull(int fd, char* buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, buf + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+}  // namespace
+
+struct URIFile::Mapping {
+    Mapping(void* a, size_t s) : addr(a), size(s){};
+    ~Mapping() { munmap(addr, size); }
+
+    void* addr;
+    size_t size;
+};
+
+URIFile::URIFile() = default;
+URIFile::URIFile(URIFile&&) = default;
+URIFile& URIFile::operator=(URIFile&&) = default;
+URIFile::~URIFile() = default;
+
+URIFile URIFile::Open(const std::string& path) {
+    URIFile file;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return file;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = static_cast<size_t>(st.st_size);
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            std::string_view data(static_cast<const char*>(addr), size);
+            // Compressed files are decompressed as they are read, instead.
+            if (DetectCompression(data.substr(0, kCompressionMagicSize)) ==
+                Compression::kNone) {
+                close(fd);
+                // Chunks are read in parallel, so read ahead the whole
+                // file, rather than sequentially.
+                madvise(addr, size, MADV_WILLNEED);
+                file.mapping_ = std::make_unique<Mapping>(addr, size);
+                file.Split(data);
+                return file;
+            }
+            munmap(addr, size);
+        }
+    }
+
+    file.ReadStream([fd](char* buf, size_t size) {
+        return ReadFull(fd, buf, size);
+    });
+    close(fd);
+    return file;
+}
+
+URIFile URIFile::Read(std::istream* in) {
+    URIFile file;
+    file.ReadStream([in](char* buf, size_t size) {
+        in->read(buf, size);
+        return static_cast<size_t>(in->gcount());
+    });
+    return file;
+}
+
+void URIFile::ReadStream(const ReadFunc& read) {
+    char head[kCompressionMagicSize];
+    size_t head_size = read(head, sizeof(head));
+    // The head is read again, before the rest of the file.
+    std::string_view unread(head, head_size);
+    bool eof = head_size < sizeof(head);
+    ReadFunc reread = [&](char* buf, size_t size) {
+        size_t done = std::min(size, unread.size());
+        std::copy_n(unread.data(), done, buf);
+        unread.remove_prefix(done);
+        if (done < size && !eof) {
+            done += read(buf + done, size - done);
+        }
+        return done;
+    };
+
+    Compression compression =
+        DetectCompression(std::string_view(head, head_size));
+    if (compression == Compression::kNone) {
+        ReadBlocks(reread);
+        return;
+    }
+    Decompressor decompressor(compression, reread);
+    ReadBlocks([&decompressor](char* buf, size_t size) {
+        return decompressor.Read(buf, size);
+    });
+    error_ = decompressor.Error();
+}
+
+void URIFile::ReadBlocks(const ReadFunc& read) {
+    Chunk chunk;
+    // The last line of a block may continue in the next block, so it is
+    // copied to the start of the next block, and split from there.
+    std::string_view partial;
+    for (;;) {
+        size_t size = std::max(kReadBlockSize, 2 * partial.size());
+        std::unique_ptr<char[]> block(new char[size]);
+        std::copy(partial.begin(), partial.end(), block.get());
+        size_t n = read(block.get() + partial.size(), size - partial.size());
+        std::string_view data(block.get(), partial.size() + n);
+        bool last = partial.size() + n < size;
+        blocks_.push_back(std::move(block));
+        if (last) {
+            SplitLines(data, &chunk);
+            break;
+        }
+        // If the block has no newline, npos + 1 wraps to 0, and the whole
+        // block is partial.
+        size_t end = data.rfind('\n') + 1;
+        SplitLines(data.substr(0, end), &chunk);
+        partial = data.substr(end);
+    }
+    uris_ = std::move(chunk.lines);
+    keys_ = std::move(chunk.keys);
+}
+
+void URIFile::Split(std::string_view data) {
+    size_t chunks = std::max<size_t>(
+        1, std::min<size_t>(std::thread::hardware_concurrency(),
+                            data.size() / kMinChunkSize));
+    std::vector<Chunk> split(chunks);
+    std::vector<std::thread> workers;
+    size_t begin = 0;
+    for (size_t i = 0; i < chunks; i++) {
+        // Chunks end just after a newline, so lines are never split across
+        // chunks. The last chunk is split on this thread.
+        size_t end = data.size();
+        if (i + 1 < chunks) {
+            end = data.find('\n', std::max(begin, data.size() * (i + 1) /
+                                                      chunks));
+            end = end == std::string_view::npos ? data.size() : end + 1;
+        }
+        std::string_view part = data.substr(begin, end - begin);
+        if (i + 1 < chunks) {
+            workers.emplace_back(SplitLines, part, &split[i]);
+        } else {
+            SplitLines(part, &split[i]);
+        }
+        begin = end;
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    uris_ = std::move(split[0].lines);
+    keys_ = std::move(split[0].keys);
+    for (size_t i = 1; i < split.size(); i++) {
+        uris_.insert(uris_.end(), split[i].lines.begin(),
+                     split[i].lines.end());
+        keys_.insert(keys_.end(), split[i].keys.begin(), split[i].keys.end());
+    }
+}
+
+void URIFile::Dedupe() {
+    // URIs are moved down over the repeated ones, in place. Only URIs
+    // before `kept` are in the index.
+    size_t kept = 0;
+    for (size_t i = 0; i < uris_.size(); i++) {
+        std::string_view uri = uris_[i];
+        uint32_t idx = index_.Find(keys_[i], keys_);
+        if (idx != internal::KeyIndex::kNotFound &&
+            (uris_[idx] == uri ||
+             std::any_of(collisions_.begin(), collisions_.end(),
+                         [&](uint32_t c) { return uris_[c] == uri; }))) {
+            continue;
+        }
+        uris_[kept] = uri;
+        keys_[kept] = keys_[i];
+        if (idx == internal::KeyIndex::kNotFound) {
+            index_.Insert(kept, keys_);
+        } else {
+            collisions_.push_back(kept);
+        }
+        kept++;
+    }
+    uris_.resize(kept);
+    keys_.resize(kept);
+}
+
+bool URIFile::Contains(std::string_view uri) const {
+    uint32_t idx = index_.Find(Fingerprint(uri), keys_);
+    if (idx == internal::KeyIndex::kNotFound) {
+        return false;
+    }
+    return uris_[idx] == uri ||
+           std::any_of(collisions_.begin(), collisions_.end(),
+                       [&](uint32_t c) { return uris_[c] == uri; });
+}
+
+}  // namespace ashuffle
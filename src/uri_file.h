@@ -0,0 +1,91 @@
+#ifndef __ASHUFFLE_URI_FILE_H__
+#define __ASHUFFLE_URI_FILE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "decompress.h"
+#include "shuffle.h"
+
+namespace ashuffle {
+
+// URIFile holds the URIs listed in a file, one per line, along with their
+// fingerprints. Lines may end in "\r\n", and blank lines are skipped. The
+// whole file is read into memory, and URIs are views into it: regular files
+// are mapped, and other files (e.g., pipes) are read in large blocks, which
+// are split into lines as they are read. Large mapped files are split into
+// lines, and hashed, on several threads. Files compressed with gzip or zstd
+// are detected by their magic number, and decompressed as they are read.
+class URIFile {
+   public:
+    // Read the file at `path`. A file that can not be opened has no URIs.
+    static URIFile Open(const std::string& path);
+
+    // Read `in` to its end.
+    static URIFile Read(std::istream* in);
+
+    // URIs point into the file's contents, which are not copied.
+    URIFile(const URIFile&) = delete;
+    URIFile& operator=(const URIFile&) = delete;
+    URIFile(URIFile&&);
+    URIFile& operator=(URIFile&&);
+    ~URIFile();
+
+    // Returns the URIs in the file, in file order. URIs listed more than
+    // once are returned more than once, until Dedupe is called.
+    const std::vector<std::string_view>& URIs() const { return uris_; }
+
+    // Returns the fingerprints of the URIs: `Keys()[i]` is the fingerprint
+    // of `URIs()[i]`.
+    const std::vector<uint64_t>& Keys() const { return keys_; }
+
+    // Remove repeated URIs, keeping the first of each, and index the URIs,
+    // for Contains.
+    void Dedupe();
+
+    // Returns true if `uri` is in the file. This takes O(1) time, but is
+    // only valid once Dedupe was called.
+    bool Contains(std::string_view uri) const;
+
+    // Returns the error that ended the file early, if any (e.g., corrupt
+    // compressed data). The URIs read before the error are kept.
+    const std::optional<std::string>& Error() const { return error_; }
+
+   private:
+    // A Mapping unmaps a file's memory map when it is destroyed.
+    struct Mapping;
+
+    URIFile();
+
+    // Split `data` into URIs.
+    void Split(std::string_view data);
+
+    // Read the file with `read`, decompressing it, if it is compressed.
+    void ReadStream(const ReadFunc& read);
+
+    // Read blocks with `read`, splitting them into URIs as they are read.
+    void ReadBlocks(const ReadFunc& read);
+
+    std::unique_ptr<Mapping> mapping_;
+    // Blocks are never moved, so that URIs stay valid as more are read.
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    // Once deduped, URIs are indexed by fingerprint. A URI whose
+    // fingerprint is taken by another URI is not in the index, and is
+    // listed in `collisions_` instead. Fingerprints are 64-bit, so this is
+    // almost always empty.
+    std::vector<std::string_view> uris_;
+    std::vector<uint64_t> keys_;
+    internal::KeyIndex index_;
+    std::vector<uint32_t> collisions_;
+    std::optional<std::string> error_;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_URI_FILE_H__
@@ -0,0 +1,55 @@
+#include "arena.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace ashuffle;
+
+using ::testing::ElementsAreArray;
+
+TEST(StringArenaTest, Append) {
+    StringArena arena;
+
+    std::string_view got = arena.Append("hello");
+    EXPECT_EQ(got, "hello");
+    // Appended strings are NUL terminated.
+    EXPECT_EQ(got.data()[got.size()], '\0');
+
+    EXPECT_EQ(arena.Append(""), "");
+}
+
+TEST(StringArenaTest, ViewsStableAcrossBlocks) {
+    StringArena arena;
+
+    // Append enough strings to need many blocks, and check that the earliest
+    // views are still valid once the arena has grown.
+    std::vector<std::string> want;
+    std::vector<std::string_view> got;
+    for (int i = 0; i < 100000; i++) {
+        want.push_back("song number " + std::to_string(i));
+        got.push_back(arena.Append(want.back()));
+    }
+
+    EXPECT_THAT(got, ElementsAreArray(want));
+}
+
+TEST(StringArenaTest, Oversized) {
+    StringArena arena;
+    (void)arena.Append("small");
+
+    std::string big(8 * 1024 * 1024, 'x');
+    EXPECT_EQ(arena.Append(big), big);
+    EXPECT_GE(arena.Allocated(), big.size());
+}
+
+TEST(StringArenaTest, Clear) {
+    StringArena arena;
+    (void)arena.Append("hello");
+    arena.Clear();
+    EXPECT_EQ(arena.Allocated(), 0);
+    EXPECT_EQ(arena.Append("world"), "world");
+}
@@ -42,8 +42,17 @@ TEST(ParseTest, Empty) {
     EXPECT_EQ(opts.port, 0U);
     EXPECT_FALSE(opts.test.print_all_songs_and_exit);
     EXPECT_TRUE(opts.group_by.empty());
+    EXPECT_TRUE(opts.spread_by.empty());
+    EXPECT_EQ(opts.tweak.spread_distance, 7);
+    EXPECT_EQ(opts.tweak.stream_startup, 0u);
+    EXPECT_EQ(opts.tweak.stream_startup_ms, 1000);
     EXPECT_EQ(opts.tweak.window_size, 7);
     EXPECT_EQ(opts.tweak.play_on_startup, true);
+    EXPECT_EQ(opts.tweak.full_cycle, false);
+    EXPECT_EQ(opts.tweak.pool_compression, PoolCompression::kNone);
+    EXPECT_EQ(opts.tweak.seed, std::nullopt);
+    EXPECT_EQ(opts.tweak.state_file, "");
+    EXPECT_EQ(opts.tweak.library_cache, "");
 }
 
 TEST(ParseTest, Short) {
@@ -106,6 +115,7 @@ TEST(ParseTest, Long) {
     EXPECT_EQ(opts.ruleset.size(), 2U);
     EXPECT_EQ(opts.queue_only, 5U);
     EXPECT_THAT(opts.file_in, NotNull());
+    EXPECT_EQ(opts.file_path, "/dev/zero");
     EXPECT_FALSE(opts.check_uris);
     EXPECT_EQ(opts.queue_buffer, 10U);
     EXPECT_EQ(opts.host, "foo");
@@ -169,6 +179,7 @@ TEST(ParseTest, FileInStdin) {
 
     opts = std::get<Options>(Options::Parse(tagger, {"--file", "-"}));
     EXPECT_EQ(opts.file_in, &std::cin);
+    EXPECT_EQ(opts.file_path, "");
 }
 
 TEST(ParseTest, ByAlbum) {
@@ -180,6 +191,21 @@ TEST(ParseTest, ByAlbum) {
         << "--by-album should be equivalent to --group-by album date";
 }
 
+TEST(ParseTest, SpreadBy) {
+    fake::TagParser tagger({
+        {"artist", MPD_TAG_ARTIST},
+        {"albumartist", MPD_TAG_ALBUM_ARTIST},
+        {"album", MPD_TAG_ALBUM},
+    });
+    Options opts = std::get<Options>(
+        Options::Parse(tagger, {"--spread-by", "artist", "albumartist", "-g",
+                                "album", "-t", "spread-distance=3"}));
+    EXPECT_THAT(opts.spread_by,
+                ElementsAre(MPD_TAG_ARTIST, MPD_TAG_ALBUM_ARTIST));
+    EXPECT_THAT(opts.group_by, ElementsAre(MPD_TAG_ALBUM));
+    EXPECT_EQ(opts.tweak.spread_distance, 3);
+}
+
 TEST(ParseTest, TweakPlayOnStartup) {
     std::vector<std::tuple<std::string, bool>> cases = {
         {"on", true},   {"true", true}, {"yes", true},    {"1", true},
@@ -194,6 +220,65 @@ TEST(ParseTest, TweakPlayOnStartup) {
     }
 }
 
+TEST(ParseTest, TweakFullCycle) {
+    Options opts = std::get<Options>(
+        Options::Parse(fake::TagParser(), {"--tweak", "full-cycle=yes"}));
+    EXPECT_EQ(opts.tweak.full_cycle, true);
+
+    opts = std::get<Options>(
+        Options::Parse(fake::TagParser(), {"--tweak", "full-cycle=off"}));
+    EXPECT_EQ(opts.tweak.full_cycle, false);
+}
+
+TEST(ParseTest, TweakPoolCompression) {
+    Options opts = std::get<Options>(Options::Parse(
+        fake::TagParser(), {"--tweak", "pool-compression=front"}));
+    EXPECT_EQ(opts.tweak.pool_compression, PoolCompression::kFront);
+
+    opts = std::get<Options>(Options::Parse(
+        fake::TagParser(), {"--tweak", "pool-compression=none"}));
+    EXPECT_EQ(opts.tweak.pool_compression, PoolCompression::kNone);
+}
+
+TEST(ParseTest, TweakStreamStartup) {
+    Options opts = std::get<Options>(Options::Parse(
+        fake::TagParser(),
+        {"-t", "stream-startup=5000", "-t", "stream-startup-ms=250"}));
+    EXPECT_EQ(opts.tweak.stream_startup, 5000u);
+    EXPECT_EQ(opts.tweak.stream_startup_ms, 250);
+}
+
+TEST(ParseTest, TweakLoadThreads) {
+    Options opts = std::get<Options>(
+        Options::Parse(fake::TagParser(), {"-t", "load-threads=4"}));
+    EXPECT_EQ(opts.tweak.load_threads, 4u);
+
+    opts = std::get<Options>(Options::Parse(fake::TagParser(), {}));
+    EXPECT_EQ(opts.tweak.load_threads, 1u);
+}
+
+TEST(ParseTest, TweakStateFile) {
+    Options opts = std::get<Options>(Options::Parse(
+        fake::TagParser(), {"--tweak", "state-file=/var/lib/a=b.state"}));
+    EXPECT_EQ(opts.tweak.state_file, "/var/lib/a=b.state");
+}
+
+TEST(ParseTest, TweakLibraryCache) {
+    Options opts = std::get<Options>(Options::Parse(
+        fake::TagParser(), {"-t", "library-cache=/home/a/.cache/library"}));
+    EXPECT_EQ(opts.tweak.library_cache, "/home/a/.cache/library");
+}
+
+TEST(ParseTest, TweakSeed) {
+    Options opts = std::get<Options>(Options::Parse(
+        fake::TagParser(), {"--tweak", "seed=18446744073709551615"}));
+    EXPECT_EQ(opts.tweak.seed, std::optional<uint64_t>(UINT64_MAX));
+
+    opts = std::get<Options>(
+        Options::Parse(fake::TagParser(), {"--tweak", "seed=0"}));
+    EXPECT_EQ(opts.tweak.seed, std::optional<uint64_t>(0));
+}
+
 using ParseFailureParam =
     std::tuple<std::vector<std::string>, Matcher<std::string>>;
 
@@ -255,6 +340,10 @@ std::vector<ParseFailureParam> partial_cases = {
      HasSubstr("'-g' can only be provided once")},
     {{"--by-album", "-g", "artist"},
      HasSubstr("'-g' can only be provided once")},
+    {{"--spread-by"}, HasSubstr("no argument supplied for '--spread-by'")},
+    {{"--spread-by", "artist", "--spread-by", "artist"},
+     HasSubstr("'--spread-by' can only be provided once")},
+    {{"--spread-by", "invalid"}, HasSubstr("invalid tag name 'invalid'")},
     {{"--tweak"}, HasSubstr("no argument supplied for '--tweak'")},
     {{"--tweak", "window-size", "fail"},
      HasSubstr("tweak must be of the form <name>=<value>")},
@@ -271,6 +360,11 @@ std::vector<ParseFailureParam> strtou_cases = {
     {{"--queue-buffer", "20U"}, MatchesRegex("couldn't convert .* '20U'")},
     {{"--tweak", "window-size=20=x"},
      MatchesRegex("couldn't convert .* '20=x'")},
+    {{"--tweak", "seed=-1"}, MatchesRegex("couldn't convert seed .* '-1'")},
+    {{"--tweak", "stream-startup=-1"},
+     MatchesRegex("couldn't convert stream-startup .* '-1'")},
+    {{"--tweak", "load-threads=two"},
+     MatchesRegex("couldn't convert load-threads .* 'two'")},
 };
 
 INSTANTIATE_TEST_SUITE_P(BadStrtou, ParseFailureTest, ValuesIn(strtou_cases));
@@ -280,8 +374,21 @@ std::vector<ParseFailureParam> constraint_cases = {
      HasSubstr("window-size must be >= 1 (0 given)")},
     {{"--tweak", "window-size=-2"},
      HasSubstr("window-size must be >= 1 (-2 given)")},
+    {{"--tweak", "spread-distance=0"},
+     HasSubstr("spread-distance must be >= 1 (0 given)")},
+    {{"--tweak", "stream-startup-ms=0"},
+     HasSubstr("stream-startup-ms must be >= 1 (0 given)")},
+    {{"--tweak", "load-threads=0"},
+     HasSubstr("load-threads must be >= 1 (0 given)")},
+    {{"--tweak", "load-threads=100000"},
+     MatchesRegex(".*load-threads must be <= [0-9]+ \\(100000 given\\)")},
     {{"--tweak", "play-on-startup=2"},
      HasSubstr("play-on-startup must be a boolean value ('2' given)")},
+    {{"--tweak", "full-cycle=maybe"},
+     HasSubstr("full-cycle must be a boolean value ('maybe' given)")},
+    {{"--tweak", "pool-compression=zip"},
+     HasSubstr("pool-compression must be one of 'none' or 'front' ('zip' "
+               "given)")},
 };
 
 INSTANTIATE_TEST_SUITE_P(Constraint, ParseFailureTest,
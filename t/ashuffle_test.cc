@@ -4,10 +4,13 @@
 #include <cassert>
 #include <cstring>
 #include <deque>
+#include <chrono>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <variant>
@@ -21,10 +24,12 @@
 
 #include "args.h"
 #include "ashuffle.h"
+#include "load.h"
 #include "mpd.h"
 #include "rule.h"
 #include "shuffle.h"
 
+#include "t/chain_items.h"
 #include "t/mpd_fake.h"
 
 #include <gmock/gmock.h>
@@ -38,10 +43,12 @@ using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::ExitedWithCode;
 using ::testing::HasSubstr;
+using ::testing::IsEmpty;
 using ::testing::Optional;
 using ::testing::Pointee;
 using ::testing::ValuesIn;
 using ::testing::WhenDynamicCastTo;
+using ::testing::WhenSorted;
 
 void xsetenv(std::string k, std::string v) {
     if (setenv(k.data(), v.data(), 1) != 0) {
@@ -80,6 +87,7 @@ class LoopTest : public testing::Test {
     fake::MPD mpd;
     ShuffleChain chain;
     Options opts;
+    MPDLoader reloader{&mpd, opts.ruleset};
 
     fake::Song song_a, song_b;
 
@@ -96,12 +104,12 @@ class LoopTest : public testing::Test {
         mpd.idle_f = [] { return mpd::IdleEventSet(MPD_IDLE_QUEUE); };
 
         // Add song_a to our chain.
-        chain.Add(song_a.URI());
+        chain.Add(song_a.uri);
     }
 };
 
 TEST_F(LoopTest, InitEmptyQueue) {
-    Loop(&mpd, &chain, opts, init_only_d);
+    Loop(&mpd, &chain, opts, &reloader, init_only_d);
 
     // We should have enqueued one song into the empty queue (song_a, the only
     // song in the chain), and started playing it.
@@ -115,7 +123,7 @@ TEST_F(LoopTest, InitWhilePlaying) {
     mpd.queue.push_back(song_a);
     mpd.PlayAt(0);
 
-    Loop(&mpd, &chain, opts, init_only_d);
+    Loop(&mpd, &chain, opts, &reloader, init_only_d);
 
     // We shouldn't add anything to the queue if we're already playing,
     // ashuffle should start silently.
@@ -131,7 +139,7 @@ TEST_F(LoopTest, InitWhileStopped) {
     mpd.state.song_position = 0;
     mpd.state.playing = false;
 
-    Loop(&mpd, &chain, opts, init_only_d);
+    Loop(&mpd, &chain, opts, &reloader, init_only_d);
 
     // ashuffle should have picked a song, added it to the queue, then started
     // playing it. The previous song in the queue should still be there.
@@ -151,7 +159,7 @@ TEST_F(LoopTest, Requeue) {
     // signal "past the end of the queue" using an empty song_position.
     mpd.state.song_position = std::nullopt;
 
-    Loop(&mpd, &chain, opts, loop_once_d);
+    Loop(&mpd, &chain, opts, &reloader, loop_once_d);
 
     // We should add a new item to the queue, and start playing.
     EXPECT_THAT(mpd.queue, ElementsAre(song_b, song_a));
@@ -166,7 +174,7 @@ TEST_F(LoopTest, RequeueEmpty) {
 
     // Leaving the MPD queue empty.
 
-    Loop(&mpd, &chain, opts, loop_once_d);
+    Loop(&mpd, &chain, opts, &reloader, loop_once_d);
 
     // We should add a new item to the queue, and start playing.
     EXPECT_THAT(mpd.queue, ElementsAre(song_a));
@@ -179,7 +187,7 @@ TEST_F(LoopTest, RequeueEmptyWithQueueBuffer) {
     opts.tweak.play_on_startup = false;
     opts.queue_buffer = 3;
 
-    Loop(&mpd, &chain, opts, loop_once_d);
+    Loop(&mpd, &chain, opts, &reloader, loop_once_d);
 
     // We should add *4* new items to the queue, and start playing on the first
     // one.
@@ -210,7 +218,7 @@ TEST_F(LoopTest, RequeueWithQueueBufferPartiallyFilled) {
     // Zero indexed, this is the second song.
     mpd.PlayAt(1);
 
-    Loop(&mpd, &chain, opts, loop_once_d);
+    Loop(&mpd, &chain, opts, &reloader, loop_once_d);
 
     // We had 3 songs in the queue, and we were playing the second song, so
     // we only need to add 2 more songs to fill out the queue buffer.
@@ -236,9 +244,9 @@ TEST_F(LoopTest, RequeueWithQueueBufferPartiallyFilledAndGrouping) {
     mpd.PlayAt(1);  // Second song.
 
     chain.Clear();
-    chain.Add(std::vector<std::string>{song_a.URI(), song_b.URI()});
+    chain.Add(std::vector<std::string>{song_a.uri, song_b.uri});
 
-    Loop(&mpd, &chain, opts, loop_once_d);
+    Loop(&mpd, &chain, opts, &reloader, loop_once_d);
 
     // We start the chain with only one group <song_a, song_b>. The queue buffer
     // is 4, and there's only one song after the current song, so we need to
@@ -251,6 +259,109 @@ TEST_F(LoopTest, RequeueWithQueueBufferPartiallyFilledAndGrouping) {
     EXPECT_THAT(mpd.Playing(), Optional(song_b));
 }
 
+// Test that a database update reloads the chain in place: new songs are
+// added, songs that left the library are removed, and songs that are still
+// in the library are kept.
+TEST_F(LoopTest, ReloadOnDatabaseUpdate) {
+    opts.tweak.play_on_startup = false;
+
+    fake::Song song_c("song_c");
+    chain.Add(song_c.uri);
+    mpd.idle_f = [] { return mpd::IdleEventSet(MPD_IDLE_DATABASE); };
+
+    Loop(&mpd, &chain, opts, &reloader, loop_once_d);
+
+    EXPECT_THAT(ChainItems(chain),
+                WhenSorted(ElementsAre(ElementsAre(song_a.uri),
+                                       ElementsAre(song_b.uri))));
+    // Reloading does not enqueue anything.
+    EXPECT_THAT(mpd.queue, IsEmpty());
+}
+
+TEST_F(LoopTest, ReloadKeepsGroups) {
+    opts.tweak.play_on_startup = false;
+    mpd.db[0].tags[MPD_TAG_ALBUM] = "__album__";
+    mpd.db[1].tags[MPD_TAG_ALBUM] = "__album__";
+    mpd.idle_f = [] { return mpd::IdleEventSet(MPD_IDLE_DATABASE); };
+
+    std::vector<enum mpd_tag_type> group_by = {MPD_TAG_ALBUM};
+    MPDLoader loader(&mpd, opts.ruleset, group_by);
+    Loop(&mpd, &chain, opts, &loader, loop_once_d);
+
+    EXPECT_THAT(ChainItems(chain),
+                ElementsAre(WhenSorted(ElementsAre(song_a.uri, song_b.uri))));
+}
+
+TEST_F(LoopTest, NoReloadFromFile) {
+    opts.tweak.play_on_startup = false;
+    mpd.idle_f = [] { return mpd::IdleEventSet(MPD_IDLE_DATABASE); };
+
+    std::istringstream file("song_a\n");
+    FileLoader loader(&file);
+    Loop(&mpd, &chain, opts, &loader, loop_once_d);
+    EXPECT_THAT(ChainItems(chain), ElementsAre(ElementsAre(song_a.uri)));
+
+    Loop(&mpd, &chain, opts, nullptr, loop_once_d);
+    EXPECT_THAT(ChainItems(chain), ElementsAre(ElementsAre(song_a.uri)));
+}
+
+// GatedLoader streams `first`, then waits for `open` before streaming
+// `rest`, and fulfills `done` once the feed is closed.
+class GatedLoader : public Loader {
+   public:
+    GatedLoader(std::string first, std::string rest)
+        : first_(first), rest_(rest){};
+
+    void Load(ShuffleChain *into) override {
+        into->Add(first_);
+        into->Add(rest_);
+    }
+
+    void Sample(Reservoir *into) override {
+        into->Add(first_);
+        into->Add(rest_);
+    }
+
+    void Stream(ShuffleFeed *into) override {
+        into->Add(first_);
+        into->Flush();
+        open.get_future().wait();
+        into->Add(rest_);
+        into->Close();
+        done.set_value();
+    }
+
+    std::promise<void> open;
+    std::promise<void> done;
+
+   private:
+    std::string first_;
+    std::string rest_;
+};
+
+TEST_F(LoopTest, BackgroundLoad) {
+    ShuffleChain streamed;
+    auto loader = std::make_unique<GatedLoader>(song_a.uri, song_b.uri);
+    GatedLoader *gate = loader.get();
+    std::future<void> done = gate->done.get_future();
+    BackgroundLoad load(nullptr, std::move(loader), &streamed);
+    load.WaitForStart(1, std::chrono::hours(1));
+
+    // Only song_a is loaded, so it is picked first.
+    Loop(&mpd, &streamed, opts, &reloader, init_only_d, &load);
+    EXPECT_THAT(mpd.queue, ElementsAre(song_a));
+    EXPECT_THAT(ChainItems(streamed), ElementsAre(ElementsAre(song_a.uri)));
+
+    // The rest of the library is added once the loop wakes up.
+    gate->open.set_value();
+    done.wait();
+    opts.tweak.play_on_startup = false;
+    Loop(&mpd, &streamed, opts, &reloader, loop_once_d, &load);
+    EXPECT_THAT(ChainItems(streamed),
+                ElementsAre(ElementsAre(song_a.uri), ElementsAre(song_b.uri)));
+    EXPECT_TRUE(load.Drain());
+}
+
 struct ConnectTestCase {
     // Want is used to set the actual server host/port.
     mpd::Address want;
@@ -0,0 +1,65 @@
+#include "binary_file.h"
+
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "t/temp_dir.h"
+
+using namespace ashuffle;
+
+using ::testing::HasSubstr;
+using ::testing::Optional;
+
+TEST(BinaryReaderTest, RoundTrip) {
+    std::string data;
+    PutInt<uint8_t>(&data, 7);
+    PutInt<uint32_t>(&data, 0xdeadbeef);
+    PutString(&data, "song_a");
+    PutInt<uint64_t>(&data, UINT64_MAX - 1);
+    // Integers are little-endian.
+    EXPECT_EQ(data.substr(1, 4), "\xef\xbe\xad\xde");
+
+    BinaryReader reader{data};
+    EXPECT_EQ(reader.Get<uint8_t>(), 7u);
+    EXPECT_EQ(reader.Get<uint32_t>(), 0xdeadbeefu);
+    EXPECT_EQ(reader.GetString(), "song_a");
+    EXPECT_EQ(reader.Get<uint64_t>(), UINT64_MAX - 1);
+    EXPECT_TRUE(reader.ok);
+    EXPECT_TRUE(reader.data.empty());
+
+    EXPECT_EQ(reader.Get<uint32_t>(), 0u);
+    EXPECT_FALSE(reader.ok);
+}
+
+TEST(BinaryReaderTest, ShortString) {
+    std::string data;
+    PutString(&data, "song_a");
+    data.pop_back();
+
+    BinaryReader reader{data};
+    EXPECT_EQ(reader.GetString(), "");
+    EXPECT_FALSE(reader.ok);
+}
+
+class WriteFileAtomicTest : public TempDirTest {
+   public:
+    WriteFileAtomicTest() : TempDirTest("file"){};
+};
+
+TEST_F(WriteFileAtomicTest, Write) {
+    ASSERT_EQ(WriteFileAtomic(path_, "test file", {"a", "bc"}), std::nullopt);
+    ASSERT_EQ(WriteFileAtomic(path_, "test file", {"def"}), std::nullopt);
+    std::stringstream contents;
+    contents << std::ifstream(path_).rdbuf();
+    EXPECT_EQ(contents.str(), "def");
+    // No temporary files are left behind.
+    EXPECT_EQ(access((path_ + ".tmp").c_str(), F_OK), -1);
+
+    EXPECT_THAT(WriteFileAtomic(dir_ + "/missing/file", "test file", {"a"}),
+                Optional(HasSubstr("failed to create test file")));
+}
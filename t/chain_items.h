@@ -0,0 +1,26 @@
+#ifndef __ASHUFFLE_T_CHAIN_ITEMS_H__
+#define __ASHUFFLE_T_CHAIN_ITEMS_H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <absl/types/span.h>
+
+#include "shuffle.h"
+
+namespace ashuffle {
+
+// ChainItems returns a copy of every item in the given chain, in the order
+// they were added. Only suitable for tests, since it copies the whole chain.
+inline std::vector<std::vector<std::string>> ChainItems(ShuffleChain& chain) {
+    std::vector<std::vector<std::string>> result;
+    chain.ForEach([&result](absl::Span<const std::string_view> uris) {
+        result.emplace_back(uris.begin(), uris.end());
+    });
+    return result;
+}
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_T_CHAIN_ITEMS_H__
@@ -0,0 +1,189 @@
+#include "decompress.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#ifdef ASHUFFLE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ASHUFFLE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace ashuffle;
+
+using ::testing::HasSubstr;
+using ::testing::Optional;
+
+namespace {
+
+// Returns a ReadFunc that reads `data`.
+ReadFunc StringReader(std::string data) {
+    auto pos = std::make_shared<size_t>(0);
+    return [data = std::move(data), pos](char* buf, size_t size) {
+        size_t n = std::min(size, data.size() - *pos);
+        std::copy_n(data.data() + *pos, n, buf);
+        *pos += n;
+        return n;
+    };
+}
+
+// Read `d` to its end, in reads of `size` bytes.
+std::string ReadAll(Decompressor* d, size_t size = 1000) {
+    std::string out;
+    std::string buf(size, '\0');
+    for (;;) {
+        size_t n = d->Read(buf.data(), buf.size());
+        out.append(buf.data(), n);
+        if (n < buf.size()) {
+            return out;
+        }
+    }
+}
+
+#if defined(ASHUFFLE_HAVE_ZLIB) || defined(ASHUFFLE_HAVE_ZSTD)
+// Returns several MiB of text, which compresses well, but not completely.
+std::string TestData() {
+    std::string data;
+    for (int i = 0; i < 300000; i++) {
+        absl::StrAppend(&data, "music/Some Artist ", i / 100, "/", i, "\n");
+    }
+    return data;
+}
+#endif
+
+#ifdef ASHUFFLE_HAVE_ZLIB
+std::string Gzip(std::string_view data) {
+    z_stream zs = {};
+    // Adding 16 to the window bits writes a gzip header.
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8,
+                 Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = out.size();
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+#endif
+
+#ifdef ASHUFFLE_HAVE_ZSTD
+std::string Zstd(std::string_view data) {
+    std::string out(ZSTD_compressBound(data.size()), '\0');
+    out.resize(ZSTD_compress(out.data(), out.size(), data.data(), data.size(),
+                             3));
+    return out;
+}
+#endif
+
+}  // namespace
+
+TEST(DetectCompressionTest, Magic) {
+    EXPECT_EQ(DetectCompression("\x1f\x8b\x08\x00"), Compression::kGzip);
+    EXPECT_EQ(DetectCompression("\x28\xb5\x2f\xfd"), Compression::kZstd);
+    EXPECT_EQ(DetectCompression("song"), Compression::kNone);
+    EXPECT_EQ(DetectCompression("\x28\xb5"), Compression::kNone);
+    EXPECT_EQ(DetectCompression(""), Compression::kNone);
+}
+
+#ifdef ASHUFFLE_HAVE_ZLIB
+
+TEST(DecompressorTest, Gzip) {
+    std::string data = TestData();
+    Decompressor d(Compression::kGzip, StringReader(Gzip(data)));
+    EXPECT_EQ(ReadAll(&d), data);
+    EXPECT_EQ(d.Error(), std::nullopt);
+}
+
+TEST(DecompressorTest, GzipConcatenated) {
+    Decompressor d(Compression::kGzip,
+                   StringReader(Gzip("song_a\n") + Gzip("song_b\n")));
+    EXPECT_EQ(ReadAll(&d), "song_a\nsong_b\n");
+    EXPECT_EQ(d.Error(), std::nullopt);
+}
+
+TEST(DecompressorTest, GzipTruncated) {
+    std::string data = TestData();
+    std::string compressed = Gzip(data);
+    compressed.resize(compressed.size() / 2);
+    Decompressor d(Compression::kGzip, StringReader(compressed));
+
+    // The data before the end is still read.
+    std::string got = ReadAll(&d);
+    EXPECT_GT(got.size(), 0u);
+    EXPECT_EQ(got, data.substr(0, got.size()));
+    EXPECT_THAT(d.Error(), Optional(HasSubstr("truncated")));
+}
+
+TEST(DecompressorTest, GzipCorrupt) {
+    std::string compressed = Gzip(TestData());
+    compressed[compressed.size() / 2] ^= 0x55;
+    Decompressor d(Compression::kGzip, StringReader(compressed));
+    ReadAll(&d);
+    EXPECT_NE(d.Error(), std::nullopt);
+}
+
+TEST(DecompressorTest, StopEarly) {
+    // The decompression thread is blocked on the reader, which stops before
+    // the end of the data.
+    Decompressor d(Compression::kGzip, StringReader(Gzip(TestData())));
+    char buf[10];
+    EXPECT_EQ(d.Read(buf, sizeof(buf)), sizeof(buf));
+    EXPECT_EQ(std::string_view(buf, sizeof(buf)), "music/Some");
+}
+
+#else
+
+TEST(DecompressorTest, GzipUnsupported) {
+    Decompressor d(Compression::kGzip, StringReader("\x1f\x8b"));
+    EXPECT_EQ(ReadAll(&d), "");
+    EXPECT_THAT(d.Error(), Optional(HasSubstr("without zlib")));
+}
+
+#endif  // ASHUFFLE_HAVE_ZLIB
+
+#ifdef ASHUFFLE_HAVE_ZSTD
+
+TEST(DecompressorTest, Zstd) {
+    std::string data = TestData();
+    Decompressor d(Compression::kZstd, StringReader(Zstd(data)));
+    EXPECT_EQ(ReadAll(&d, 1 << 20), data);
+    EXPECT_EQ(d.Error(), std::nullopt);
+}
+
+TEST(DecompressorTest, ZstdConcatenated) {
+    Decompressor d(Compression::kZstd,
+                   StringReader(Zstd("song_a\n") + Zstd("song_b\n")));
+    EXPECT_EQ(ReadAll(&d), "song_a\nsong_b\n");
+    EXPECT_EQ(d.Error(), std::nullopt);
+}
+
+TEST(DecompressorTest, ZstdTruncated) {
+    std::string data = TestData();
+    std::string compressed = Zstd(data);
+    compressed.resize(compressed.size() / 2);
+    Decompressor d(Compression::kZstd, StringReader(compressed));
+
+    std::string got = ReadAll(&d);
+    EXPECT_EQ(got, data.substr(0, got.size()));
+    EXPECT_THAT(d.Error(), Optional(HasSubstr("truncated")));
+}
+
+#else
+
+TEST(DecompressorTest, ZstdUnsupported) {
+    Decompressor d(Compression::kZstd, StringReader("\x28\xb5\x2f\xfd"));
+    EXPECT_EQ(ReadAll(&d), "");
+    EXPECT_THAT(d.Error(), Optional(HasSubstr("without zstd")));
+}
+
+#endif  // ASHUFFLE_HAVE_ZSTD
@@ -0,0 +1,73 @@
+#include "fenwick.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace ashuffle;
+
+TEST(FenwickTreeTest, Empty) {
+    FenwickTree tree;
+    EXPECT_EQ(tree.Size(), 0u);
+    EXPECT_EQ(tree.Total(), 0u);
+}
+
+TEST(FenwickTreeTest, BuildMatchesPushBack) {
+    std::vector<uint64_t> weights;
+    for (uint64_t i = 0; i < 37; i++) {
+        weights.push_back(i * 7 % 5);
+    }
+    FenwickTree built(weights);
+    FenwickTree pushed;
+    for (uint64_t w : weights) {
+        pushed.PushBack(w);
+    }
+
+    ASSERT_EQ(built.Size(), weights.size());
+    ASSERT_EQ(pushed.Size(), weights.size());
+    uint64_t sum = 0;
+    for (size_t i = 0; i < weights.size(); i++) {
+        EXPECT_EQ(built.Get(i), weights[i]) << "index " << i;
+        EXPECT_EQ(pushed.Get(i), weights[i]) << "index " << i;
+        EXPECT_EQ(built.Prefix(i), sum);
+        EXPECT_EQ(pushed.Prefix(i), sum);
+        sum += weights[i];
+    }
+    EXPECT_EQ(built.Total(), sum);
+    EXPECT_EQ(pushed.Total(), sum);
+}
+
+TEST(FenwickTreeTest, Find) {
+    // Zero weights are never found.
+    FenwickTree tree({2, 0, 1, 0, 0, 3});
+    std::vector<size_t> want = {0, 0, 2, 5, 5, 5};
+    ASSERT_EQ(tree.Total(), want.size());
+    for (uint64_t target = 0; target < tree.Total(); target++) {
+        EXPECT_EQ(tree.Find(target), want[target]) << "target " << target;
+    }
+}
+
+TEST(FenwickTreeTest, Add) {
+    FenwickTree tree({1, 1, 1, 1, 1});
+    tree.Add(2, -1);
+    tree.Add(4, 5);
+    EXPECT_EQ(tree.Total(), 9u);
+    EXPECT_EQ(tree.Get(2), 0u);
+    EXPECT_EQ(tree.Get(4), 6u);
+    EXPECT_EQ(tree.Find(2), 3u);
+    EXPECT_EQ(tree.Find(3), 4u);
+    EXPECT_EQ(tree.Find(8), 4u);
+
+    tree.PopBack();
+    EXPECT_EQ(tree.Size(), 4u);
+    EXPECT_EQ(tree.Total(), 3u);
+    tree.PushBack(2);
+    EXPECT_EQ(tree.Total(), 5u);
+    EXPECT_EQ(tree.Find(4), 4u);
+
+    tree.Clear();
+    EXPECT_EQ(tree.Size(), 0u);
+    EXPECT_EQ(tree.Total(), 0u);
+}
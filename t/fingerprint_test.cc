@@ -0,0 +1,37 @@
+#include "fingerprint.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace ashuffle;
+
+// Fingerprints are used as persistent identities, so they must never change.
+// These values were computed with an independent MurmurHash64A
+// implementation.
+TEST(FingerprintTest, Stable) {
+    EXPECT_EQ(Fingerprint(""), 0xa3a6b83f2ac2875cu);
+    EXPECT_EQ(Fingerprint("a"), 0xe1a18bdc8affe439u);
+    EXPECT_EQ(Fingerprint("song.flac"), 0x6db283b64976a641u);
+    EXPECT_EQ(Fingerprint("Artist/Album (2020)/01 - Title.flac"),
+              0x100de7869cf09979u);
+}
+
+TEST(FingerprintTest, Distinct) {
+    std::unordered_set<uint64_t> seen;
+    for (int i = 0; i < 10000; i++) {
+        EXPECT_TRUE(seen.insert(Fingerprint(absl::StrCat("song ", i))).second)
+            << "collision for song " << i;
+    }
+}
+
+TEST(FingerprintTest, Combine) {
+    uint64_t a = Fingerprint("a");
+    uint64_t b = Fingerprint("b");
+    EXPECT_EQ(FingerprintCombine(a, b), FingerprintCombine(a, b));
+    EXPECT_NE(FingerprintCombine(a, b), FingerprintCombine(b, a));
+}
@@ -0,0 +1,61 @@
+#include "front_coded.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace ashuffle;
+
+TEST(FrontCodedDictTest, Empty) {
+    FrontCodedDict dict(std::vector<std::string_view>{});
+    EXPECT_EQ(dict.Size(), 0);
+}
+
+TEST(FrontCodedDictTest, RoundTrip) {
+    // Enough strings to span several blocks, with a mix of shared and
+    // unshared prefixes, and an empty string.
+    std::vector<std::string> want = {""};
+    for (int artist = 0; artist < 10; artist++) {
+        for (int track = 0; track < 7; track++) {
+            want.push_back(absl::StrCat("Artist ", artist, "/Album (2020)/",
+                                        track, " - Title.flac"));
+        }
+    }
+    want.push_back(std::string(300, 'z'));
+    std::sort(want.begin(), want.end());
+
+    std::vector<std::string_view> views(want.begin(), want.end());
+    FrontCodedDict dict(views);
+    ASSERT_EQ(dict.Size(), want.size());
+
+    std::string got;
+    for (size_t i = 0; i < want.size(); i++) {
+        dict.Get(i, &got);
+        EXPECT_EQ(got, want[i]) << "id " << i;
+    }
+    // Lookups are independent of each other.
+    dict.Get(want.size() - 1, &got);
+    EXPECT_EQ(got, want.back());
+    dict.Get(3, &got);
+    EXPECT_EQ(got, want[3]);
+}
+
+TEST(FrontCodedDictTest, CompressesSharedPrefixes) {
+    std::vector<std::string> uris;
+    size_t raw = 0;
+    for (int i = 0; i < 1000; i++) {
+        uris.push_back(absl::StrCat(
+            "Some Artist/Some Album With A Long Name (1999)/", 1000 + i,
+            ".flac"));
+        raw += uris.back().size();
+    }
+    std::vector<std::string_view> views(uris.begin(), uris.end());
+    FrontCodedDict dict(views);
+
+    EXPECT_LT(dict.Bytes(), raw / 4);
+}
@@ -0,0 +1,127 @@
+#include "library_cache.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "t/temp_dir.h"
+
+using namespace ashuffle;
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::Optional;
+using ::testing::VariantWith;
+
+namespace {
+
+// A copy of a LibraryCache::Entry, which outlives the load.
+struct Loaded {
+    uint64_t key;
+    std::vector<std::string> uris;
+    std::vector<std::string> tags;
+};
+
+class LibraryCacheTest : public TempDirTest {
+   public:
+    LibraryCacheTest() : TempDirTest("library"){};
+
+    std::vector<Loaded> loaded_;
+
+    // Load the cache at `path_` with the given key into `loaded_`.
+    std::variant<bool, std::string> Load(uint64_t key) {
+        loaded_.clear();
+        return LibraryCache(path_).Load(
+            key, [this](const LibraryCache::Entry& entry) {
+                loaded_.push_back(Loaded{
+                    entry.key,
+                    {entry.uris.begin(), entry.uris.end()},
+                    {entry.tags.begin(), entry.tags.end()},
+                });
+            });
+    }
+
+    std::string ReadFile() {
+        std::ifstream in(path_, std::ios::binary);
+        std::stringstream data;
+        data << in.rdbuf();
+        return data.str();
+    }
+
+    void WriteFile(const std::string& data) {
+        std::ofstream out(path_, std::ios::binary);
+        out << data;
+    }
+
+    // Save a cache with a few items, under key 7.
+    void SaveTestCache() {
+        LibraryCache cache(path_);
+        std::vector<std::string> single = {"song_a"};
+        std::vector<std::string> group = {"song_b", "song_c"};
+        std::vector<std::string> tags = {"1:artist"};
+        cache.Record(1, single, {});
+        cache.Record(2, group, tags);
+        ASSERT_EQ(cache.Save(7), std::nullopt);
+    }
+};
+
+}  // namespace
+
+TEST_F(LibraryCacheTest, RoundTrip) {
+    SaveTestCache();
+    EXPECT_THAT(Load(7), VariantWith<bool>(true));
+    ASSERT_EQ(loaded_.size(), 2u);
+    EXPECT_EQ(loaded_[0].key, 1u);
+    EXPECT_THAT(loaded_[0].uris, ElementsAre("song_a"));
+    EXPECT_THAT(loaded_[0].tags, IsEmpty());
+    EXPECT_EQ(loaded_[1].key, 2u);
+    EXPECT_THAT(loaded_[1].uris, ElementsAre("song_b", "song_c"));
+    EXPECT_THAT(loaded_[1].tags, ElementsAre("1:artist"));
+}
+
+TEST_F(LibraryCacheTest, SaveClearsRecorded) {
+    LibraryCache cache(path_);
+    std::vector<std::string> uris = {"song_a"};
+    cache.Record(1, uris, {});
+    ASSERT_EQ(cache.Save(7), std::nullopt);
+    ASSERT_EQ(cache.Save(8), std::nullopt);
+
+    EXPECT_THAT(Load(8), VariantWith<bool>(true));
+    EXPECT_THAT(loaded_, IsEmpty());
+}
+
+TEST_F(LibraryCacheTest, Miss) {
+    // A missing cache is not an error.
+    EXPECT_THAT(Load(7), VariantWith<bool>(false));
+
+    // Neither is a cache made with another key.
+    SaveTestCache();
+    EXPECT_THAT(Load(8), VariantWith<bool>(false));
+    EXPECT_THAT(loaded_, IsEmpty());
+}
+
+TEST_F(LibraryCacheTest, Corrupt) {
+    SaveTestCache();
+    std::string data = ReadFile();
+    data[data.size() - 12] ^= 0x55;
+    WriteFile(data);
+
+    // Nothing is loaded from a corrupt cache.
+    EXPECT_THAT(Load(7), VariantWith<std::string>(HasSubstr("corrupt")));
+    EXPECT_THAT(loaded_, IsEmpty());
+
+    WriteFile("song_a\nsong_b\n");
+    EXPECT_THAT(Load(7),
+                VariantWith<std::string>(HasSubstr("not a library cache")));
+}
+
+TEST_F(LibraryCacheTest, SaveError) {
+    LibraryCache cache(dir_ + "/missing/library");
+    EXPECT_THAT(cache.Save(7), Optional(HasSubstr("missing")));
+}
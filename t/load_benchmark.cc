@@ -0,0 +1,165 @@
+#include "load.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+#include <benchmark/benchmark.h>
+
+#include "library_cache.h"
+#include "rule.h"
+#include "shuffle.h"
+#include "t/mpd_fake.h"
+
+using namespace ashuffle;
+
+namespace {
+
+// Load a library of 100,000 songs through 50 exclude rules, with the
+// number of verify threads given by the benchmark's argument.
+void BM_LoadVerifyThreads(benchmark::State& state) {
+    fake::MPD mpd;
+    for (int i = 0; i < 100000; i++) {
+        mpd.db.push_back(fake::Song(
+            absl::StrCat("artist_", i % 997, "/album_", i % 89, "/", i),
+            {{MPD_TAG_ARTIST, absl::StrCat("artist_", i % 997)},
+             {MPD_TAG_ALBUM, absl::StrCat("album_", i % 89)}}));
+    }
+    std::vector<Rule> ruleset;
+    for (int i = 0; i < 50; i++) {
+        Rule rule;
+        rule.AddPattern(MPD_TAG_ARTIST, absl::StrCat("artist_", i * 13));
+        rule.AddPattern(MPD_TAG_ALBUM, absl::StrCat("album_", i));
+        ruleset.push_back(rule);
+    }
+
+    for (auto _ : state) {
+        ShuffleChain chain;
+        MPDLoader loader(static_cast<mpd::MPD*>(&mpd), ruleset);
+        loader.SetVerifyThreads(state.range(0));
+        loader.Load(&chain);
+        benchmark::DoNotOptimize(chain.Len());
+    }
+    state.SetItemsProcessed(state.iterations() * mpd.db.size());
+}
+BENCHMARK(BM_LoadVerifyThreads)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Load a library of 100,000 songs, by 2,000 artists on 10,000 albums,
+// grouped by the fields given by the benchmark's argument: 0 for
+// `-g artist`, and 1 for `--by-album` (album and date).
+void BM_LoadGroupBy(benchmark::State& state) {
+    fake::MPD mpd;
+    for (int i = 0; i < 100000; i++) {
+        int album = i / 10;
+        mpd.db.push_back(fake::Song(
+            absl::StrCat("music/", album, "/", i, ".flac"),
+            {{MPD_TAG_ARTIST, absl::StrCat("Some Artist ", album / 5)},
+             {MPD_TAG_ALBUM, absl::StrCat("Some Album Title ", album)},
+             {MPD_TAG_DATE, absl::StrCat(1950 + album % 70)},
+             {MPD_TAG_TITLE, absl::StrCat("Song ", i)}}));
+    }
+    std::vector<Rule> ruleset;
+    std::vector<enum mpd_tag_type> group_by = {MPD_TAG_ARTIST};
+    if (state.range(0) == 1) {
+        group_by = {MPD_TAG_ALBUM, MPD_TAG_DATE};
+    }
+
+    for (auto _ : state) {
+        ShuffleChain chain;
+        MPDLoader loader(static_cast<mpd::MPD*>(&mpd), ruleset, group_by);
+        loader.Load(&chain);
+        benchmark::DoNotOptimize(chain.Len());
+    }
+    state.SetItemsProcessed(state.iterations() * mpd.db.size());
+}
+BENCHMARK(BM_LoadGroupBy)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Load a file of 1,000,000 URIs, read from a stream (argument 0), or from
+// its path (argument 1).
+void BM_LoadFile(benchmark::State& state) {
+    std::string contents;
+    for (int i = 0; i < 1000000; i++) {
+        absl::StrAppend(&contents, "music/Some Artist ", i / 100,
+                        "/Some Album Title ", i / 10, "/", i, ".flac\n");
+    }
+    char tmpl[] = "/tmp/ashuffle-load-benchmark.XXXXXX";
+    int fd = mkstemp(tmpl);
+    if (fd < 0) {
+        state.SkipWithError("could not create the URI file");
+        return;
+    }
+    close(fd);
+    std::string path(tmpl);
+    std::ofstream(path) << contents;
+
+    for (auto _ : state) {
+        ShuffleChain chain;
+        if (state.range(0) == 0) {
+            std::istringstream in(contents);
+            FileLoader(&in).Load(&chain);
+        } else {
+            FileLoader(path).Load(&chain);
+        }
+        benchmark::DoNotOptimize(chain.Len());
+    }
+    state.SetItemsProcessed(state.iterations() * 1000000);
+    unlink(path.c_str());
+}
+BENCHMARK(BM_LoadFile)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// Load a library of 500,000 songs from MPD (argument 0), or from a library
+// cache (argument 1). The fake MPD lists songs from memory, so this
+// understates the time saved compared to a real MPD.
+void BM_LoadCache(benchmark::State& state) {
+    fake::MPD mpd;
+    mpd.db_updated = 100;
+    for (int i = 0; i < 500000; i++) {
+        mpd.db.push_back(fake::Song(
+            absl::StrCat("music/Some Artist ", i / 100, "/Some Album Title ",
+                         i / 10, "/", i, ".flac"),
+            {{MPD_TAG_ARTIST, absl::StrCat("Some Artist ", i / 100)}}));
+    }
+    std::vector<Rule> ruleset;
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "Some Artist 7");
+    ruleset.push_back(rule);
+
+    char tmpl[] = "/tmp/ashuffle-load-benchmark.XXXXXX";
+    if (mkdtemp(tmpl) == nullptr) {
+        state.SkipWithError("could not create the cache directory");
+        return;
+    }
+    std::string dir(tmpl);
+    std::string path = dir + "/library";
+    MPDLoader warm(static_cast<mpd::MPD*>(&mpd), ruleset);
+    warm.SetCache(LibraryCache(path));
+    ShuffleChain warm_chain;
+    warm.Load(&warm_chain);
+
+    for (auto _ : state) {
+        ShuffleChain chain;
+        MPDLoader loader(static_cast<mpd::MPD*>(&mpd), ruleset);
+        if (state.range(0) == 1) {
+            loader.SetCache(LibraryCache(path));
+        }
+        loader.Load(&chain);
+        benchmark::DoNotOptimize(chain.Len());
+    }
+    state.SetItemsProcessed(state.iterations() * mpd.db.size());
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+}
+BENCHMARK(BM_LoadCache)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
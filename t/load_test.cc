@@ -1,21 +1,31 @@
+#include <chrono>
 #include <istream>
 #include <memory>
 #include <sstream>
 
 #include "args.h"
+#include "library_cache.h"
 #include "load.h"
 #include "mpd.h"
 #include "rule.h"
 #include "shuffle.h"
+#include "shuffle_feed.h"
 
+#include "t/chain_items.h"
 #include "t/mpd_fake.h"
+#include "t/temp_dir.h"
 
+#include <absl/strings/str_cat.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 using namespace ashuffle;
 
 using ::testing::ContainerEq;
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+using ::testing::IsEmpty;
+using ::testing::Optional;
 using ::testing::WhenSorted;
 
 TEST(MPDLoaderTest, Basic) {
@@ -30,7 +40,7 @@ TEST(MPDLoaderTest, Basic) {
     loader.Load(&chain);
 
     std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_b"}};
-    EXPECT_THAT(chain.Items(), WhenSorted(ContainerEq(want)));
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
 }
 
 TEST(MPDLoaderTest, WithFilter) {
@@ -53,7 +63,7 @@ TEST(MPDLoaderTest, WithFilter) {
     loader.Load(&chain);
 
     std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_c"}};
-    EXPECT_THAT(chain.Items(), WhenSorted(ContainerEq(want)));
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
 }
 
 TEST(MPDLoaderTest, WithGroup) {
@@ -70,7 +80,266 @@ TEST(MPDLoaderTest, WithGroup) {
     loader.Load(&chain);
 
     std::vector<std::string> want = {"song_a", "song_b"};
-    EXPECT_THAT(chain.Pick(), WhenSorted(ContainerEq(want)));
+    EXPECT_THAT(chain.Pick(), WhenSorted(ElementsAreArray(want)));
+}
+
+TEST(MPDLoaderTest, WithSpread) {
+    fake::MPD mpd;
+    // Most songs are by one artist.
+    for (int i = 0; i < 40; i++) {
+        mpd.db.push_back(fake::Song(absl::StrCat("a/", i),
+                                    {{MPD_TAG_ARTIST, "__artist_a__"}}));
+    }
+    for (int i = 0; i < 20; i++) {
+        mpd.db.push_back(fake::Song(absl::StrCat("b", i, "/", i),
+                                    {{MPD_TAG_ARTIST, absl::StrCat(i)}}));
+    }
+    std::vector<Rule> ruleset;
+    std::vector<enum mpd_tag_type> group_by;
+    std::vector<enum mpd_tag_type> spread_by = {MPD_TAG_ARTIST};
+
+    // Returns the number of picks by the same artist as the pick before.
+    auto repeats = [&](const std::vector<enum mpd_tag_type> &spread) {
+        ShuffleChain chain(3, Xoshiro256(7));
+        chain.SetTagCooldown(1);
+        MPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by,
+                         spread);
+        loader.Load(&chain);
+        int n = 0;
+        std::string last;
+        for (int i = 0; i < 1000; i++) {
+            std::string uri(chain.Pick()[0]);
+            std::string artist = uri.substr(0, uri.find('/'));
+            n += artist == last;
+            last = artist;
+        }
+        return n;
+    };
+
+    // Without tags, the cooldown has no effect.
+    EXPECT_GT(repeats(group_by), 400);
+    EXPECT_LT(repeats(spread_by), 50);
+}
+
+TEST(MPDLoaderTest, ListsOnlyNeededTags) {
+    fake::MPD mpd;
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ARTIST, "__artist__"},
+                                           {MPD_TAG_ALBUM, "__album__"},
+                                           {MPD_TAG_GENRE, "__genre__"},
+                                           {MPD_TAG_COMMENT, "__comment__"}}));
+    mpd.db.push_back(fake::Song("song_b", {{MPD_TAG_ARTIST, "__excluded__"},
+                                           {MPD_TAG_ALBUM, "__album__"}}));
+
+    std::vector<Rule> ruleset;
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "__excluded__");
+    rule.AddPattern(MPD_TAG_GENRE, "__excluded__");
+    ruleset.push_back(rule);
+    std::vector<enum mpd_tag_type> group_by = {MPD_TAG_ALBUM};
+    std::vector<enum mpd_tag_type> spread_by = {MPD_TAG_ARTIST};
+
+    ShuffleChain chain;
+    MPDLoader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by, spread_by)
+        .Load(&chain);
+    std::vector<std::vector<std::string>> want = {{"song_a"}};
+    EXPECT_THAT(ChainItems(chain), ContainerEq(want));
+    EXPECT_THAT(mpd.listed_tags,
+                Optional(WhenSorted(ElementsAre(MPD_TAG_ARTIST, MPD_TAG_ALBUM,
+                                                MPD_TAG_GENRE))));
+
+    // Without rules or groups, only URIs are needed.
+    std::vector<Rule> no_rules;
+    ShuffleChain uris;
+    MPDLoader(static_cast<mpd::MPD *>(&mpd), no_rules).Load(&uris);
+    EXPECT_EQ(uris.Len(), 2u);
+    EXPECT_THAT(mpd.listed_tags, Optional(IsEmpty()));
+}
+
+TEST(MPDLoaderTest, ExcludesInMPD) {
+    fake::MPD mpd;
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ARTIST, "__artist__"}}));
+    mpd.db.push_back(fake::Song("song_b", {{MPD_TAG_ARTIST, "__Excluded__"}}));
+    mpd.db.push_back(fake::Song("song_c", {{MPD_TAG_ALBUM, "__excluded__"}}));
+
+    std::vector<Rule> ruleset;
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "EXCLUDED");
+    ruleset.push_back(rule);
+
+    ShuffleChain chain;
+    MPDLoader(static_cast<mpd::MPD *>(&mpd), ruleset).Load(&chain);
+    std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_c"}};
+    EXPECT_THAT(ChainItems(chain), ContainerEq(want));
+    ASSERT_EQ(mpd.listed_exclusions.size(), 1u);
+    EXPECT_EQ(mpd.listed_exclusions[0].tag, MPD_TAG_ARTIST);
+    EXPECT_EQ(mpd.listed_exclusions[0].value, "excluded");
+}
+
+TEST(MPDLoaderTest, ExcludesFallbackTagsInClient) {
+    fake::MPD mpd;
+    // MPD matches songs without an AlbumArtist on their Artist, so it would
+    // leave out song_a, which the rule accepts.
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ARTIST, "__excluded__"}}));
+    mpd.db.push_back(
+        fake::Song("song_b", {{MPD_TAG_ALBUM_ARTIST, "__excluded__"}}));
+    mpd.db.push_back(fake::Song("song_c", {{MPD_TAG_ARTIST, "__artist__"}}));
+
+    std::vector<Rule> ruleset;
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ALBUM_ARTIST, "excluded");
+    ruleset.push_back(rule);
+
+    ShuffleChain chain;
+    MPDLoader(static_cast<mpd::MPD *>(&mpd), ruleset).Load(&chain);
+    std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_c"}};
+    EXPECT_THAT(ChainItems(chain), ContainerEq(want));
+    EXPECT_THAT(mpd.listed_exclusions, IsEmpty());
+}
+
+TEST(MPDLoaderTest, VerifyThreads) {
+    fake::MPD mpd;
+    // Enough songs for several batches, and a partial one at the end.
+    for (int i = 0; i < 5000; i++) {
+        mpd.db.push_back(fake::Song(
+            absl::StrCat("song_", i),
+            {{MPD_TAG_ARTIST, absl::StrCat("artist_", i % 7)},
+             {MPD_TAG_ALBUM, absl::StrCat("album_", i % 101)}}));
+    }
+
+    std::vector<Rule> ruleset;
+    for (int i : {2, 5}) {
+        Rule rule;
+        rule.AddPattern(MPD_TAG_ARTIST, absl::StrCat("artist_", i));
+        ruleset.push_back(rule);
+    }
+    std::vector<enum mpd_tag_type> spread_by = {MPD_TAG_ARTIST};
+
+    // Returns the loaded items and the first picks of a seeded chain.
+    auto load = [&](const std::vector<enum mpd_tag_type> &group_by,
+                    unsigned threads) {
+        ShuffleChain chain(3, Xoshiro256(7));
+        chain.SetTagCooldown(1);
+        MPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by,
+                         spread_by);
+        loader.SetVerifyThreads(threads);
+        loader.Load(&chain);
+        std::vector<std::vector<std::string>> items = ChainItems(chain);
+        for (int i = 0; i < 100; i++) {
+            absl::Span<const std::string_view> pick = chain.Pick();
+            items.emplace_back(pick.begin(), pick.end());
+        }
+        return items;
+    };
+
+    for (const std::vector<enum mpd_tag_type> &group_by :
+         {std::vector<enum mpd_tag_type>(),
+          std::vector<enum mpd_tag_type>{MPD_TAG_ALBUM}}) {
+        std::vector<std::vector<std::string>> want = load(group_by, 1);
+        for (unsigned threads : {2, 3, 8}) {
+            EXPECT_THAT(load(group_by, threads), ContainerEq(want))
+                << threads << " threads";
+        }
+    }
+}
+
+TEST(MPDLoaderTest, Reload) {
+    fake::MPD mpd;
+    mpd.db_updated = 100;
+    for (std::string uri : {"song_a", "song_b", "song_c"}) {
+        mpd.db.push_back(fake::Song(uri, {{MPD_TAG_ARTIST, "__artist__"}}));
+        mpd.db.back().modified = 50;
+    }
+
+    std::vector<Rule> ruleset;
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "__excluded__");
+    ruleset.push_back(rule);
+
+    ShuffleChain chain;
+    MPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset);
+    loader.Load(&chain);
+    // The first reload loads every song.
+    loader.Reload(&chain);
+    EXPECT_EQ(mpd.list_all_calls, 2u);
+    EXPECT_EQ(chain.Len(), 3u);
+
+    // song_a is re-tagged, and excluded, song_b is removed, song_d is
+    // added, and song_e is added with an old modification time.
+    mpd.db[0].tags[MPD_TAG_ARTIST] = "__excluded__";
+    mpd.db[0].modified = 150;
+    mpd.db.erase(mpd.db.begin() + 1);
+    mpd.db.push_back(fake::Song("song_d", {{MPD_TAG_ARTIST, "__artist__"}}));
+    mpd.db.back().modified = 160;
+    mpd.db.push_back(fake::Song("song_e", {{MPD_TAG_ARTIST, "__artist__"}}));
+    mpd.db.back().modified = 10;
+    mpd.db_updated = 200;
+
+    loader.Reload(&chain);
+    EXPECT_EQ(mpd.list_all_calls, 2u);
+    std::vector<std::vector<std::string>> want = {
+        {"song_c"}, {"song_d"}, {"song_e"}};
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+
+    // song_a is included again. It was modified before the last update,
+    // but after the one before it.
+    mpd.db[0].tags[MPD_TAG_ARTIST] = "__artist__";
+    mpd.db[0].modified = 190;
+    mpd.db_updated = 300;
+    loader.Reload(&chain);
+    EXPECT_EQ(mpd.list_all_calls, 2u);
+    want = {{"song_a"}, {"song_c"}, {"song_d"}, {"song_e"}};
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+
+    // Without a way to list modified songs, every song is loaded again.
+    mpd.list_modified = false;
+    mpd.db.pop_back();
+    mpd.db_updated = 400;
+    loader.Reload(&chain);
+    EXPECT_EQ(mpd.list_all_calls, 3u);
+    want = {{"song_a"}, {"song_c"}, {"song_d"}};
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+}
+
+TEST(MPDLoaderTest, ReloadManyOldSongs) {
+    fake::MPD mpd;
+    mpd.db_updated = 100;
+    std::vector<Rule> ruleset;
+    ShuffleChain chain;
+    MPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset);
+    loader.Reload(&chain);
+    EXPECT_EQ(mpd.list_all_calls, 1u);
+
+    // Too many songs are added with old modification times to fetch them
+    // one by one, so every song is loaded again.
+    for (int i = 0; i < 1000; i++) {
+        mpd.db.push_back(fake::Song(absl::StrCat("song_", i)));
+    }
+    mpd.db_updated = 200;
+    loader.Reload(&chain);
+    EXPECT_EQ(mpd.list_all_calls, 2u);
+    EXPECT_EQ(chain.Len(), 1000u);
+}
+
+TEST(MPDLoaderTest, ReloadGroups) {
+    fake::MPD mpd;
+    mpd.db_updated = 100;
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ALBUM, "__album__"}}));
+    mpd.db.push_back(fake::Song("song_b", {{MPD_TAG_ALBUM, "__album__"}}));
+
+    std::vector<Rule> ruleset;
+    std::vector<enum mpd_tag_type> group_by = {MPD_TAG_ALBUM};
+    ShuffleChain chain;
+    MPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by);
+    loader.Load(&chain);
+
+    // Groups are always reloaded in full.
+    mpd.db[1].tags[MPD_TAG_ALBUM] = "__other__";
+    mpd.db_updated = 200;
+    loader.Reload(&chain);
+    loader.Reload(&chain);
+    EXPECT_EQ(mpd.list_all_calls, 3u);
+    std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_b"}};
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
 }
 
 std::unique_ptr<std::istream> TestStream(std::vector<std::string> lines) {
@@ -82,18 +351,45 @@ TEST(FileLoaderTest, Basic) {
     fake::Song song_a("song_a"), song_b("song_b"), song_c("song_c");
 
     std::unique_ptr<std::istream> s = TestStream({
-        song_a.URI(),
-        song_b.URI(),
-        song_c.URI(),
+        song_a.uri,
+        song_b.uri,
+        song_c.uri,
     });
 
     FileLoader loader(s.get());
     loader.Load(&chain);
 
     std::vector<std::vector<std::string>> want = {
-        {song_a.URI()}, {song_b.URI()}, {song_c.URI()}};
+        {song_a.uri}, {song_b.uri}, {song_c.uri}};
+
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+}
+
+TEST(FileLoaderTest, Duplicates) {
+    ShuffleChain chain;
+    std::unique_ptr<std::istream> s =
+        TestStream({"song_a", "song_b", "", "song_a", "song_c\r"});
+
+    FileLoader loader(s.get());
+    loader.Load(&chain);
+
+    // Songs listed twice are only loaded once, and blank lines are skipped.
+    std::vector<std::vector<std::string>> want = {
+        {"song_a"}, {"song_b"}, {"song_c"}};
+    EXPECT_THAT(ChainItems(chain), ContainerEq(want));
+}
+
+TEST(FileLoaderTest, SampleDuplicates) {
+    std::unique_ptr<std::istream> s =
+        TestStream({"song_a", "song_b", "song_a", "song_a", "song_c"});
 
-    EXPECT_THAT(chain.Items(), WhenSorted(ContainerEq(want)));
+    // Like Load, Sample only sees songs listed twice once, so they can't
+    // be sampled twice.
+    Reservoir songs(10, Xoshiro256(1));
+    FileLoader(s.get()).Sample(&songs);
+    std::vector<std::vector<std::string>> want = {
+        {"song_a"}, {"song_b"}, {"song_c"}};
+    EXPECT_THAT(songs.Take(), WhenSorted(ContainerEq(want)));
 }
 
 TEST(FileMPDLoaderTest, Basic) {
@@ -129,12 +425,12 @@ TEST(FileMPDLoaderTest, Basic) {
 
     // step 5. Set up our test input file, but writing the URIs of our songs.
     std::unique_ptr<std::istream> s = TestStream({
-        song_a.URI(),
-        song_b.URI(),
-        song_c.URI(),
+        song_a.uri,
+        song_b.uri,
+        song_c.uri,
         // But we do want to write song_d here, so that ashuffle has to check
         // it.
-        song_d.URI(),
+        song_d.uri,
     });
 
     // step 6. Run! (and validate)
@@ -143,7 +439,287 @@ TEST(FileMPDLoaderTest, Basic) {
                          s.get());
     loader.Load(&chain);
 
-    std::vector<std::vector<std::string>> want = {{song_a.URI()},
-                                                  {song_c.URI()}};
-    EXPECT_THAT(chain.Items(), WhenSorted(ContainerEq(want)));
+    std::vector<std::vector<std::string>> want = {{song_a.uri},
+                                                  {song_c.uri}};
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+}
+
+TEST(FileMPDLoaderTest, ExactURIs) {
+    fake::MPD mpd;
+    for (std::string uri :
+         {"song_a", "song_ab", "song_abc", "song_", "Song_a", "song_a "}) {
+        mpd.db.push_back(fake::Song(uri));
+    }
+    std::vector<Rule> ruleset;
+    std::vector<enum mpd_tag_type> group_by;
+
+    // Duplicate lines are only stored once, and only exact matches are
+    // loaded.
+    std::unique_ptr<std::istream> s =
+        TestStream({"song_a", "song_ab", "song_a", "song_x"});
+    ShuffleChain chain;
+    FileMPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by,
+                         s.get());
+    loader.Load(&chain);
+
+    std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_ab"}};
+    EXPECT_THAT(ChainItems(chain), ContainerEq(want));
+}
+
+TEST(FileMPDLoaderTest, LooksUpFewSongs) {
+    fake::MPD mpd;
+    for (int i = 0; i < 1000; i++) {
+        mpd.db.push_back(fake::Song(absl::StrCat("song_", i),
+                                    {{MPD_TAG_ARTIST, "__artist__"}}));
+    }
+    mpd.db[7].tags[MPD_TAG_ARTIST] = "__not_artist__";
+
+    std::vector<Rule> ruleset;
+    Rule artist_match;
+    artist_match.AddPattern(MPD_TAG_ARTIST, "__not_artist__");
+    ruleset.push_back(artist_match);
+    std::vector<enum mpd_tag_type> group_by;
+
+    // A few songs are looked up, in file order, without listing every
+    // song. Rules still apply, and missing songs are skipped.
+    std::unique_ptr<std::istream> s =
+        TestStream({"song_42", "song_7", "song_3", "song_x"});
+    ShuffleChain chain;
+    FileMPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by,
+                         s.get());
+    loader.Load(&chain);
+
+    std::vector<std::vector<std::string>> want = {{"song_42"}, {"song_3"}};
+    EXPECT_THAT(ChainItems(chain), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 0u);
+
+    // Lists that are large compared to the library are still loaded from
+    // a listing of every song.
+    mpd.db.erase(mpd.db.begin() + 100, mpd.db.end());
+    ShuffleChain full_chain;
+    s = TestStream({"song_42", "song_7", "song_3", "song_x"});
+    FileMPDLoader full_loader(static_cast<mpd::MPD *>(&mpd), ruleset,
+                              group_by, s.get());
+    full_loader.Load(&full_chain);
+
+    want = {{"song_3"}, {"song_42"}};
+    EXPECT_THAT(ChainItems(full_chain), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 1u);
+}
+
+TEST(MPDLoaderTest, Stream) {
+    fake::MPD mpd;
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ALBUM, "__album__"}}));
+    mpd.db.push_back(fake::Song("song_b", {{MPD_TAG_ALBUM, "__album__"}}));
+    mpd.db.push_back(fake::Song("song_c", {{MPD_TAG_ALBUM, "__other__"}}));
+
+    std::vector<Rule> ruleset;
+    std::vector<enum mpd_tag_type> group_by = {MPD_TAG_ALBUM};
+
+    ShuffleChain chain;
+    ShuffleFeed feed(&chain);
+    MPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by);
+    loader.Stream(&feed);
+    EXPECT_EQ(feed.Drain(), 2u);
+    EXPECT_TRUE(feed.Done());
+
+    ShuffleChain loaded;
+    loader.Load(&loaded);
+    EXPECT_THAT(ChainItems(chain), ContainerEq(ChainItems(loaded)));
+}
+
+TEST(BackgroundLoadTest, Basic) {
+    std::vector<std::string> uris;
+    for (int i = 0; i < 5000; i++) {
+        uris.push_back(absl::StrCat("song_", i));
+    }
+    std::unique_ptr<std::istream> s = TestStream(uris);
+
+    ShuffleChain chain;
+    BackgroundLoad load(nullptr, std::make_unique<FileLoader>(s.get()),
+                        &chain);
+    load.WaitForStart(10, std::chrono::hours(1));
+    EXPECT_GE(chain.Len(), 10u);
+
+    while (!load.Drain()) {
+    }
+    std::vector<std::vector<std::string>> want;
+    for (const std::string &uri : uris) {
+        want.push_back({uri});
+    }
+    EXPECT_THAT(ChainItems(chain), ContainerEq(want));
+    EXPECT_TRUE(load.Drain());
+}
+
+TEST(BackgroundLoadTest, StartBudget) {
+    std::unique_ptr<std::istream> s = TestStream({"song_a", "song_b"});
+
+    ShuffleChain chain;
+    BackgroundLoad load(nullptr, std::make_unique<FileLoader>(s.get()),
+                        &chain);
+    // There are fewer songs than the count, so this only returns once the
+    // load is done.
+    load.WaitForStart(100, std::chrono::hours(1));
+    EXPECT_EQ(chain.Len(), 2u);
+    EXPECT_TRUE(load.Drain());
+}
+
+TEST(MPDLoaderTest, Sample) {
+    fake::MPD mpd;
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ALBUM, "__album__"}}));
+    mpd.db.push_back(fake::Song("song_b", {{MPD_TAG_ALBUM, "__other__"}}));
+    mpd.db.push_back(fake::Song("song_c", {{MPD_TAG_ALBUM, "__album__"}}));
+    mpd.db.push_back(fake::Song("song_d", {{MPD_TAG_ARTIST, "__excluded__"},
+                                           {MPD_TAG_ALBUM, "__excluded__"}}));
+
+    std::vector<Rule> ruleset;
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "__excluded__");
+    ruleset.push_back(rule);
+
+    Reservoir songs(10, Xoshiro256(1));
+    MPDLoader(static_cast<mpd::MPD *>(&mpd), ruleset).Sample(&songs);
+    std::vector<std::vector<std::string>> want = {
+        {"song_a"}, {"song_b"}, {"song_c"}};
+    EXPECT_THAT(songs.Take(), WhenSorted(ContainerEq(want)));
+
+    std::vector<enum mpd_tag_type> group_by = {MPD_TAG_ALBUM};
+    Reservoir groups(10, Xoshiro256(1));
+    MPDLoader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by)
+        .Sample(&groups);
+    want = {{"song_a", "song_c"}, {"song_b"}};
+    EXPECT_THAT(groups.Take(), WhenSorted(ContainerEq(want)));
+}
+
+// LoadCacheTest tests loaders with a library cache in a temporary
+// directory.
+class LoadCacheTest : public TempDirTest {
+   public:
+    LoadCacheTest() : TempDirTest("library"){};
+
+    LibraryCache Cache() const { return LibraryCache(path_); }
+};
+
+TEST_F(LoadCacheTest, MPDLoader) {
+    fake::MPD mpd;
+    mpd.db_updated = 100;
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ARTIST, "__artist__"}}));
+    mpd.db.push_back(fake::Song("song_b", {{MPD_TAG_ARTIST, "__other__"}}));
+    mpd.db.push_back(fake::Song("song_c", {{MPD_TAG_ARTIST, "__artist__"}}));
+
+    std::vector<Rule> ruleset;
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "__other__");
+    ruleset.push_back(rule);
+    std::vector<enum mpd_tag_type> group_by;
+    std::vector<enum mpd_tag_type> spread_by = {MPD_TAG_ARTIST};
+
+    auto load = [&](const std::vector<Rule> &rules) {
+        ShuffleChain chain;
+        MPDLoader loader(static_cast<mpd::MPD *>(&mpd), rules, group_by,
+                         spread_by);
+        loader.SetCache(Cache());
+        loader.Load(&chain);
+        return ChainItems(chain);
+    };
+
+    std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_c"}};
+    EXPECT_THAT(load(ruleset), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 1u);
+
+    // The second load is read from the cache, so it does not see changes
+    // that MPD did not report as an update.
+    mpd.db.push_back(fake::Song("song_d"));
+    EXPECT_THAT(load(ruleset), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 1u);
+
+    // Songs are listed again after an update, or with other rules.
+    mpd.db_updated = 200;
+    want = {{"song_a"}, {"song_c"}, {"song_d"}};
+    EXPECT_THAT(load(ruleset), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 2u);
+    want = {{"song_a"}, {"song_b"}, {"song_c"}, {"song_d"}};
+    EXPECT_THAT(load({}), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 3u);
+    EXPECT_THAT(load({}), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 3u);
+
+    // Nothing is cached when MPD does not know when it was updated.
+    mpd.db_updated = 0;
+    load({});
+    load({});
+    EXPECT_EQ(mpd.list_all_calls, 5u);
+}
+
+TEST_F(LoadCacheTest, Groups) {
+    fake::MPD mpd;
+    mpd.db_updated = 100;
+    mpd.db.push_back(fake::Song("song_a", {{MPD_TAG_ALBUM, "__album__"}}));
+    mpd.db.push_back(fake::Song("song_b", {{MPD_TAG_ALBUM, "__other__"}}));
+    mpd.db.push_back(fake::Song("song_c", {{MPD_TAG_ALBUM, "__album__"}}));
+
+    std::vector<Rule> ruleset;
+    std::vector<enum mpd_tag_type> group_by = {MPD_TAG_ALBUM};
+
+    ShuffleChain chain;
+    MPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by);
+    loader.SetCache(Cache());
+    loader.Load(&chain);
+
+    // Groups keep their keys, so a chain loaded from the cache is updated
+    // in place by a later reload.
+    ShuffleChain cached;
+    ShuffleFeed feed(&cached);
+    MPDLoader cached_loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by);
+    cached_loader.SetCache(Cache());
+    cached_loader.Stream(&feed);
+    EXPECT_EQ(feed.Drain(), 2u);
+    EXPECT_EQ(mpd.list_all_calls, 1u);
+    EXPECT_THAT(ChainItems(cached), ContainerEq(ChainItems(chain)));
+
+    mpd.db_updated = 200;
+    cached_loader.Reload(&cached);
+    EXPECT_EQ(mpd.list_all_calls, 2u);
+    EXPECT_THAT(ChainItems(cached), ContainerEq(ChainItems(chain)));
+
+    // Samples are read from the cache, too.
+    Reservoir groups(10, Xoshiro256(1));
+    MPDLoader sample_loader(static_cast<mpd::MPD *>(&mpd), ruleset, group_by);
+    sample_loader.SetCache(Cache());
+    sample_loader.Sample(&groups);
+    EXPECT_EQ(mpd.list_all_calls, 2u);
+    std::vector<std::vector<std::string>> want = {{"song_a", "song_c"},
+                                                  {"song_b"}};
+    EXPECT_THAT(groups.Take(), WhenSorted(ContainerEq(want)));
+}
+
+TEST_F(LoadCacheTest, FileMPDLoader) {
+    fake::MPD mpd;
+    mpd.db_updated = 100;
+    mpd.db.emplace_back("song_a");
+    mpd.db.emplace_back("song_b");
+    mpd.db.emplace_back("song_c");
+
+    std::vector<Rule> ruleset;
+    std::vector<enum mpd_tag_type> group_by;
+
+    auto load = [&](std::vector<std::string> lines) {
+        std::unique_ptr<std::istream> s = TestStream(lines);
+        ShuffleChain chain;
+        FileMPDLoader loader(static_cast<mpd::MPD *>(&mpd), ruleset,
+                             group_by, s.get());
+        loader.SetCache(Cache());
+        loader.Load(&chain);
+        return ChainItems(chain);
+    };
+
+    // The cache is only used with the same file.
+    std::vector<std::vector<std::string>> want = {{"song_a"}, {"song_c"}};
+    EXPECT_THAT(load({"song_c", "song_a"}), ContainerEq(want));
+    EXPECT_THAT(load({"song_c", "song_a"}), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 1u);
+
+    want = {{"song_b"}, {"song_c"}};
+    EXPECT_THAT(load({"song_b", "song_c"}), ContainerEq(want));
+    EXPECT_EQ(mpd.list_all_calls, 2u);
 }
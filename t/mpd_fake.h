@@ -1,11 +1,19 @@
 #ifndef __ASHUFFLE_T_MPD_FAKE_H__
 #define __ASHUFFLE_T_MPD_FAKE_H__
 
+#include <algorithm>
+#include <cctype>
+#include <ctime>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include <absl/strings/str_format.h>
 #include <absl/strings/str_join.h>
@@ -32,6 +40,11 @@ class Song : public mpd::Song {
     using tag_map = std::unordered_map<enum mpd_tag_type, std::string>;
     std::string uri;
     tag_map tags;
+    // The values of each tag after the first, for songs with several values
+    // for a tag (e.g., several artists).
+    std::unordered_map<enum mpd_tag_type, std::vector<std::string>> more_tags;
+    // The modification time of the song's file.
+    time_t modified = 0;
 
     Song() : Song("", {}){};
     Song(std::string_view u) : Song(u, {}){};
@@ -45,10 +58,32 @@ class Song : public mpd::Song {
         return tags.at(tag);
     }
 
-    std::string URI() const override { return uri; }
+    std::optional<std::string_view> TagView(
+        enum mpd_tag_type tag) const override {
+        auto it = tags.find(tag);
+        if (it == tags.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    std::vector<std::string_view> TagValues(
+        enum mpd_tag_type tag) const override {
+        std::vector<std::string_view> values;
+        if (auto it = tags.find(tag); it != tags.end()) {
+            values.push_back(it->second);
+        }
+        if (auto it = more_tags.find(tag); it != more_tags.end()) {
+            values.insert(values.end(), it->second.begin(), it->second.end());
+        }
+        return values;
+    }
+
+    std::string_view URI() const override { return uri; }
 
     bool operator==(const Song& other) const {
-        return uri == other.uri && tags == other.tags;
+        return uri == other.uri && tags == other.tags &&
+               more_tags == other.more_tags;
     }
 
     friend std::ostream& operator<<(std::ostream& os, const Song& s) {
@@ -153,8 +188,33 @@ class MPD : public mpd::MPD {
     mpd::IdleEventSet (*idle_f)() = [] { return mpd::IdleEventSet(); };
     std::string active_user;
     user_map users;
+    // The tags and exclusions given to the last ListAll call that listed
+    // only some tags. Excluded songs are left out of the list.
+    std::optional<std::vector<enum mpd_tag_type>> listed_tags;
+    std::vector<mpd::Exclusion> listed_exclusions;
+    // The time of the last database update, and whether the fake supports
+    // listing modified songs.
+    time_t db_updated = 0;
+    bool list_modified = true;
+    // The number of calls to ListAll, with or without tags.
+    unsigned list_all_calls = 0;
 
     std::unique_ptr<mpd::SongReader> ListAll() override;
+    std::unique_ptr<mpd::SongReader> ListModifiedSince(
+        time_t since, absl::Span<const enum mpd_tag_type> tags) override;
+
+    void ListURIs(const std::function<void(std::string_view)>& f) override {
+        dbg() << "call:ListURIs" << std::endl;
+        for (const Song& song : db) {
+            f(song.uri);
+        }
+    }
+
+    time_t DatabaseUpdated() override { return db_updated; }
+
+    unsigned DatabaseSongs() override {
+        return static_cast<unsigned>(db.size());
+    }
 
     // state: Play, Pause, PlayAt, GetStatus
     // DB: ListAll, Search, Add
@@ -196,7 +256,7 @@ class MPD : public mpd::MPD {
         dbg() << "call:Idle" << std::endl;
         return idle_f();
     };
-    void Add(const std::string& uri) override {
+    void Add(std::string_view uri) override {
         dbg() << "call:Add(" << uri << ")" << std::endl;
         std::optional<Song> found = SearchInternal(uri);
         assert(found && "cannot add URI not in DB");
@@ -249,6 +309,11 @@ class MPD : public mpd::MPD {
         return queue[*state.song_position];
     };
 
+   protected:
+    std::unique_ptr<mpd::SongReader> ListAllMatching(
+        absl::Span<const enum mpd_tag_type> tags,
+        absl::Span<const mpd::Exclusion> exclude) override;
+
    private:
     std::optional<Song> SearchInternal(std::string_view uri) {
         for (Song& song : db) {
@@ -302,28 +367,129 @@ class SongReader : public mpd::SongReader {
     ~SongReader() override = default;
 
     SongReader(const MPD& mpd) : cur_(mpd.db.begin()), end_(mpd.db.end()){};
+    // Songs are listed with only the given tags, and without the songs
+    // that match any of the given exclusions, or were modified before
+    // `since`.
+    SongReader(const MPD& mpd, std::vector<enum mpd_tag_type> tags,
+               std::vector<mpd::Exclusion> exclude, time_t since = 0)
+        : SongReader(mpd) {
+        tags_ = std::move(tags);
+        exclude_ = std::move(exclude);
+        since_ = since;
+    };
 
     std::optional<std::unique_ptr<mpd::Song>> Next() override {
         if (Done()) {
             return std::nullopt;
         }
-        return std::unique_ptr<mpd::Song>(new Song(*cur_++));
+        auto song = std::make_unique<Song>(*cur_++);
+        if (tags_) {
+            Song::tag_map tags;
+            for (enum mpd_tag_type tag : *tags_) {
+                if (auto it = song->tags.find(tag); it != song->tags.end()) {
+                    tags.insert(*it);
+                }
+            }
+            song->tags = std::move(tags);
+        }
+        return std::unique_ptr<mpd::Song>(std::move(song));
     };
 
     // Done returns true when there are no more songs to get. After Done
     // returns true, future calls to `Next` will return an empty option.
-    bool Done() override { return cur_ == end_; }
+    bool Done() override {
+        while (cur_ != end_ && Skipped(*cur_)) {
+            cur_++;
+        }
+        return cur_ == end_;
+    }
 
    private:
+    bool Skipped(const Song& song) const {
+        if (song.modified < since_) {
+            return true;
+        }
+        auto lower = [](std::string s) {
+            std::transform(s.begin(), s.end(), s.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            return s;
+        };
+        for (const mpd::Exclusion& e : exclude_) {
+            std::vector<std::string_view> values = FilterValues(song, e.tag);
+            // An empty value matches songs that lack the tag.
+            if (e.value.empty() && values.empty()) {
+                return true;
+            }
+            for (std::string_view value : values) {
+                if (!e.value.empty() &&
+                    lower(std::string(value)).find(lower(e.value)) !=
+                        std::string::npos) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Returns the values MPD's filters match for `tag`. Like MPD, songs that
+    // lack AlbumArtist, or a *Sort tag, are matched on a fallback tag.
+    static std::vector<std::string_view> FilterValues(
+        const Song& song, enum mpd_tag_type tag) {
+        std::vector<std::string_view> values = song.TagValues(tag);
+        if (!values.empty()) {
+            return values;
+        }
+        if (tag == MPD_TAG_ALBUM_ARTIST_SORT) {
+            values = song.TagValues(MPD_TAG_ALBUM_ARTIST);
+            return values.empty() ? FilterValues(song, MPD_TAG_ARTIST_SORT)
+                                  : values;
+        }
+        if (tag == MPD_TAG_ALBUM_ARTIST) {
+            return song.TagValues(MPD_TAG_ARTIST);
+        }
+        std::string_view name = mpd_tag_name(tag);
+        if (name.size() > 4 && name.substr(name.size() - 4) == "Sort") {
+            std::string base(name.substr(0, name.size() - 4));
+            return song.TagValues(mpd_tag_name_iparse(base.c_str()));
+        }
+        return values;
+    }
+
     std::vector<Song>::const_iterator cur_;
     std::vector<Song>::const_iterator end_;
+    std::optional<std::vector<enum mpd_tag_type>> tags_;
+    std::vector<mpd::Exclusion> exclude_;
+    time_t since_ = 0;
 };
 
 std::unique_ptr<mpd::SongReader> MPD::ListAll() {
     dbg() << "call:ListAll" << std::endl;
+    list_all_calls++;
     return std::unique_ptr<mpd::SongReader>(new SongReader(*this));
 }
 
+std::unique_ptr<mpd::SongReader> MPD::ListAllMatching(
+    absl::Span<const enum mpd_tag_type> tags,
+    absl::Span<const mpd::Exclusion> exclude) {
+    dbg() << "call:ListAllMatching" << std::endl;
+    list_all_calls++;
+    listed_tags.emplace(tags.begin(), tags.end());
+    listed_exclusions.assign(exclude.begin(), exclude.end());
+    return std::unique_ptr<mpd::SongReader>(
+        new SongReader(*this, *listed_tags, listed_exclusions));
+}
+
+std::unique_ptr<mpd::SongReader> MPD::ListModifiedSince(
+    time_t since, absl::Span<const enum mpd_tag_type> tags) {
+    dbg() << "call:ListModifiedSince" << std::endl;
+    if (!list_modified) {
+        return nullptr;
+    }
+    return std::unique_ptr<mpd::SongReader>(new SongReader(
+        *this, std::vector<enum mpd_tag_type>(tags.begin(), tags.end()),
+        std::vector<mpd::Exclusion>(), since));
+}
+
 class Dialer : public mpd::Dialer {
    public:
     ~Dialer() override = default;
@@ -0,0 +1,74 @@
+#include "random.h"
+
+#include <cstdint>
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+using namespace ashuffle;
+
+namespace {
+
+// The ranges used below cycle through pool-like sizes, so the compiler can't
+// specialize the division for a constant range.
+constexpr uint32_t kRanges[] = {3, 1000, 65537, 1000003, 10000019};
+constexpr size_t kNumRanges = sizeof(kRanges) / sizeof(kRanges[0]);
+
+// The path ShuffleChain used to use: a std::mt19937, with a new
+// std::uniform_int_distribution built for every draw.
+void BM_MT19937Distribution(benchmark::State& state) {
+    std::mt19937 rng(42);
+    size_t i = 0;
+    for (auto _ : state) {
+        uint32_t range = kRanges[i++ % kNumRanges];
+        std::uniform_int_distribution<unsigned long long> rd{0, range - 1};
+        benchmark::DoNotOptimize(rd(rng));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MT19937Distribution);
+
+// std::mt19937 with Lemire's bounded sampling, to separate the cost of the
+// generator from the cost of the range reduction.
+void BM_MT19937Bounded(benchmark::State& state) {
+    std::mt19937 rng(42);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Bounded(rng, kRanges[i++ % kNumRanges]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MT19937Bounded);
+
+// The default ShuffleChain path: Xoshiro256 with Lemire's bounded sampling.
+void BM_Xoshiro256Bounded(benchmark::State& state) {
+    Xoshiro256 rng(42);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Bounded(rng, kRanges[i++ % kNumRanges]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Xoshiro256Bounded);
+
+void BM_SeedMT19937(benchmark::State& state) {
+    uint32_t seed = 0;
+    for (auto _ : state) {
+        std::mt19937 rng(seed++);
+        benchmark::DoNotOptimize(rng);
+    }
+}
+BENCHMARK(BM_SeedMT19937);
+
+void BM_SeedXoshiro256(benchmark::State& state) {
+    uint64_t seed = 0;
+    for (auto _ : state) {
+        Xoshiro256 rng(seed++);
+        benchmark::DoNotOptimize(rng);
+    }
+}
+BENCHMARK(BM_SeedXoshiro256);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,129 @@
+#include "random.h"
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace ashuffle;
+
+using ::testing::ElementsAre;
+
+namespace {
+
+// FixedGenerator is a 32-bit UniformRandomBitGenerator that returns the
+// given values in order.
+class FixedGenerator {
+   public:
+    using result_type = uint32_t;
+
+    FixedGenerator(std::vector<uint32_t> values) : values_(values){};
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+
+    result_type operator()() { return values_.at(next_++); }
+
+    size_t Draws() const { return next_; }
+
+   private:
+    std::vector<uint32_t> values_;
+    size_t next_ = 0;
+};
+
+}  // namespace
+
+// Outputs of the reference xoshiro256** implementation, for a fixed state.
+TEST(Xoshiro256Test, MatchesReference) {
+    Xoshiro256 rng(Xoshiro256::State{1, 2, 3, 4});
+    std::vector<uint64_t> got;
+    for (int i = 0; i < 4; i++) {
+        got.push_back(rng());
+    }
+    EXPECT_THAT(got, ElementsAre(11520u, 0u, 1509978240u,
+                                 1215971899390074240u));
+}
+
+TEST(Xoshiro256Test, SeedIsDeterministic) {
+    Xoshiro256 a(42);
+    Xoshiro256 b(42);
+    Xoshiro256 c(43);
+    EXPECT_EQ(a.GetState(), b.GetState());
+    EXPECT_NE(a.GetState(), c.GetState());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(a(), b());
+    }
+}
+
+TEST(Xoshiro256Test, StateRoundTrip) {
+    Xoshiro256 rng(7);
+    (void)rng();
+    Xoshiro256 restored(rng.GetState());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(rng(), restored());
+    }
+}
+
+TEST(BoundedTest, InRange) {
+    Xoshiro256 rng(1);
+    for (uint32_t range : {1u, 2u, 3u, 7u, 1000u, UINT32_MAX}) {
+        for (int i = 0; i < 1000; i++) {
+            ASSERT_LT(Bounded(rng, range), range) << "range: " << range;
+        }
+    }
+}
+
+TEST(BoundedTest, InRange64) {
+    Xoshiro256 rng(1);
+    std::mt19937 rng32(1);
+    for (uint64_t range : {uint64_t{1}, uint64_t{3}, uint64_t{1} << 40,
+                           UINT64_MAX}) {
+        for (int i = 0; i < 1000; i++) {
+            ASSERT_LT(Bounded64(rng, range), range) << "range: " << range;
+            ASSERT_LT(Bounded64(rng32, range), range) << "range: " << range;
+        }
+    }
+}
+
+TEST(BoundedTest, RejectsBiasedValues) {
+    // For a range of 3, 2^32 mod 3 = 1, so exactly one 32-bit input (0) must
+    // be rejected to keep the output unbiased.
+    FixedGenerator gen({0, UINT32_MAX});
+    EXPECT_EQ(Bounded(gen, 3), 2u);
+    EXPECT_EQ(gen.Draws(), 2u);
+
+    // Other inputs are accepted on the first draw, and map to the high bits
+    // of the product.
+    FixedGenerator gen2({UINT32_MAX / 3 + 1});
+    EXPECT_EQ(Bounded(gen2, 3), 1u);
+    EXPECT_EQ(gen2.Draws(), 1u);
+}
+
+TEST(BoundedTest, UsesHighBitsOf64BitGenerators) {
+    std::mt19937_64 rng(5);
+    std::mt19937_64 ref(5);
+    EXPECT_EQ(Bits32(rng), static_cast<uint32_t>(ref() >> 32));
+
+    std::mt19937 rng32(5);
+    std::mt19937 ref32(5);
+    EXPECT_EQ(Bits32(rng32), ref32());
+}
+
+TEST(BoundedTest, Uniform) {
+    constexpr uint32_t kRange = 6;
+    constexpr int kDraws = 60000;
+    Xoshiro256 rng(99);
+    std::array<int, kRange> counts = {};
+    for (int i = 0; i < kDraws; i++) {
+        counts[Bounded(rng, kRange)]++;
+    }
+    // Each bucket should be within 5% of its expected count. With this many
+    // draws, that's over 6 standard deviations.
+    constexpr int kWant = kDraws / kRange;
+    for (int count : counts) {
+        EXPECT_NEAR(count, kWant, kWant / 20);
+    }
+}
@@ -0,0 +1,109 @@
+#include "reservoir.h"
+
+#include <array>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace ashuffle;
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::SizeIs;
+using ::testing::UnorderedElementsAre;
+
+TEST(ReservoirTest, FewerItemsThanSlots) {
+    Reservoir reservoir(5, Xoshiro256(1));
+    reservoir.Add("a");
+    reservoir.Add("b");
+    reservoir.Add("c");
+    EXPECT_EQ(reservoir.Seen(), 3u);
+    EXPECT_THAT(reservoir.Take(),
+                UnorderedElementsAre(ElementsAre("a"), ElementsAre("b"),
+                                     ElementsAre("c")));
+    EXPECT_THAT(reservoir.Take(), IsEmpty());
+}
+
+TEST(ReservoirTest, KeepsN) {
+    Reservoir reservoir(20, Xoshiro256(2));
+    for (int i = 0; i < 10000; i++) {
+        reservoir.Add(absl::StrCat(i));
+    }
+    EXPECT_EQ(reservoir.Seen(), 10000u);
+    std::vector<std::vector<std::string>> sample = reservoir.Take();
+    ASSERT_THAT(sample, SizeIs(20));
+    std::set<std::string> unique;
+    for (const auto& item : sample) {
+        ASSERT_THAT(item, SizeIs(1));
+        unique.insert(item[0]);
+    }
+    EXPECT_THAT(unique, SizeIs(20));
+}
+
+// Every item is equally likely to be sampled, no matter where it is in the
+// stream, and every slot of the result is equally likely to hold any item.
+TEST(ReservoirTest, IsUniform) {
+    constexpr int items = 10;
+    constexpr int trials = 20000;
+    std::array<int, items> sampled = {};
+    std::array<int, items> first = {};
+    Xoshiro256 seeds(3);
+    for (int t = 0; t < trials; t++) {
+        Reservoir reservoir(3, Xoshiro256(seeds()));
+        for (int i = 0; i < items; i++) {
+            reservoir.Add(absl::StrCat(i));
+        }
+        std::vector<std::vector<std::string>> sample = reservoir.Take();
+        for (const auto& item : sample) {
+            sampled[std::stoi(item[0])]++;
+        }
+        first[std::stoi(sample[0][0])]++;
+    }
+    // Each item is sampled with probability 3/10, and comes first with
+    // probability 1/10. Allow for 5 standard deviations of noise.
+    for (int i = 0; i < items; i++) {
+        EXPECT_NEAR(sampled[i], trials * 3 / 10, 330) << "item " << i;
+        EXPECT_NEAR(first[i], trials / 10, 215) << "item " << i;
+    }
+}
+
+TEST(ReservoirTest, Groups) {
+    Reservoir reservoir(2, Xoshiro256(4));
+    // Group URIs are interleaved. Every group is sampled, since there are
+    // only two.
+    reservoir.AddToGroup(1, "a1");
+    reservoir.AddToGroup(2, "b1");
+    reservoir.AddToGroup(1, "a2");
+    reservoir.AddToGroup(2, "b2");
+    reservoir.AddToGroup(1, "a3");
+    EXPECT_EQ(reservoir.Seen(), 2u);
+    EXPECT_THAT(reservoir.Take(),
+                UnorderedElementsAre(ElementsAre("a1", "a2", "a3"),
+                                     ElementsAre("b1", "b2")));
+}
+
+// Sampled groups always hold all of their URIs, even once many groups have
+// been seen, and groups are counted once, no matter how many URIs they have.
+TEST(ReservoirTest, GroupsAreComplete) {
+    Reservoir reservoir(5, Xoshiro256(5));
+    for (int round = 0; round < 4; round++) {
+        for (uint64_t group = 0; group < 100; group++) {
+            reservoir.AddToGroup(group, absl::StrCat(group, "/", round));
+        }
+    }
+    EXPECT_EQ(reservoir.Seen(), 100u);
+    std::vector<std::vector<std::string>> sample = reservoir.Take();
+    ASSERT_THAT(sample, SizeIs(5));
+    for (const auto& item : sample) {
+        std::string group = item[0].substr(0, item[0].find('/'));
+        EXPECT_THAT(item, ElementsAre(absl::StrCat(group, "/0"),
+                                      absl::StrCat(group, "/1"),
+                                      absl::StrCat(group, "/2"),
+                                      absl::StrCat(group, "/3")));
+    }
+}
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <string_view>
+#include <vector>
 
 #include <mpd/tag.h>
 
@@ -86,3 +87,64 @@ TEST(Rule, MultiplePatterns) {
     EXPECT_FALSE(rule.Accepts(partial_match_album));
     EXPECT_TRUE(rule.Accepts(no_match));
 }
+
+TEST(Rule, MultipleValues) {
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "__artist__");
+
+    fake::Song second_match({{MPD_TAG_ARTIST, "no match"}});
+    second_match.more_tags[MPD_TAG_ARTIST] = {"other", "__ARTIST__"};
+
+    fake::Song no_match({{MPD_TAG_ARTIST, "no match"}});
+    no_match.more_tags[MPD_TAG_ARTIST] = {"other"};
+
+    EXPECT_FALSE(rule.Accepts(second_match))
+        << "song accepted even though its second artist matches";
+    EXPECT_TRUE(rule.Accepts(no_match));
+}
+
+TEST(Rule, AppendExclusions) {
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "Foo");
+    rule.AddPattern(MPD_TAG_ALBUM, "\xc3\x89t\xc3\xa9");  // "Été"
+    rule.AddPattern(MPD_TAG_GENRE, "bar");
+    rule.AddPattern(MPD_TAG_ALBUM_ARTIST, "foo");
+    rule.AddPattern(MPD_TAG_ALBUM_SORT, "foo");
+    rule.AddPattern(MPD_TAG_COMPOSER, "");
+
+    std::vector<mpd::Exclusion> exclude;
+    rule.AppendExclusions(&exclude);
+
+    // Patterns MPD matches differently are left to Accepts: MPD folds the
+    // case of non-ASCII values differently, matches songs without an
+    // AlbumArtist or AlbumSort on a fallback tag, and matches songs without
+    // a composer on an empty value.
+    ASSERT_EQ(exclude.size(), 2u);
+    EXPECT_EQ(exclude[0].tag, MPD_TAG_ARTIST);
+    EXPECT_EQ(exclude[0].value, "foo");
+    EXPECT_EQ(exclude[1].tag, MPD_TAG_GENRE);
+    EXPECT_EQ(exclude[1].value, "bar");
+}
+
+TEST(Rule, Digest) {
+    Rule rule;
+    rule.AddPattern(MPD_TAG_ARTIST, "__artist__");
+    rule.AddPattern(MPD_TAG_ALBUM, "__album__");
+
+    // Patterns are compared case-insensitively, so their case does not
+    // change the digest.
+    Rule same;
+    same.AddPattern(MPD_TAG_ARTIST, "__ARTIST__");
+    same.AddPattern(MPD_TAG_ALBUM, "__album__");
+    EXPECT_EQ(rule.Digest(), same.Digest());
+
+    Rule other_tag;
+    other_tag.AddPattern(MPD_TAG_ALBUM, "__artist__");
+    other_tag.AddPattern(MPD_TAG_ALBUM, "__album__");
+    EXPECT_NE(rule.Digest(), other_tag.Digest());
+
+    Rule fewer;
+    fewer.AddPattern(MPD_TAG_ARTIST, "__artist__");
+    EXPECT_NE(rule.Digest(), fewer.Digest());
+    EXPECT_NE(fewer.Digest(), Rule().Digest());
+}
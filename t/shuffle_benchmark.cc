@@ -0,0 +1,134 @@
+#include "shuffle.h"
+
+#include <malloc.h>
+#include <string>
+
+#include <absl/strings/str_cat.h>
+#include <benchmark/benchmark.h>
+
+using namespace ashuffle;
+
+namespace {
+
+// Returns a URI shaped like the ones found in a typical MPD library, with
+// 10 songs per album and 10 albums per artist.
+std::string LibraryURI(int64_t i) {
+    return absl::StrCat("Artist Number ", i / 100, "/Album Title ", i / 10 % 10,
+                        " (", 1970 + i / 10 % 50, ")/", i % 10,
+                        " - Some Song Title.flac");
+}
+
+// Measure the cost of a single Pick as the chain grows. Pick should take
+// constant time, so the per-iteration time should stay flat across the whole
+// range of chain sizes.
+void BM_Pick(benchmark::State& state) {
+    ShuffleChain chain(7, Xoshiro256(42));
+    for (int64_t i = 0; i < state.range(0); i++) {
+        chain.Add(absl::StrCat(i));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(chain.Pick());
+    }
+    state.SetLabel(absl::StrCat(chain.Len(), " items"));
+}
+BENCHMARK(BM_Pick)->RangeMultiplier(10)->Range(10000, 10000000);
+
+// Measure a Pick in full-cycle mode, which never repeats an item within a
+// pass over the whole chain, and should cost the same as BM_Pick.
+void BM_PickFullCycle(benchmark::State& state) {
+    ShuffleChain chain(ShuffleChain::kFullCycle, Xoshiro256(42));
+    for (int64_t i = 0; i < state.range(0); i++) {
+        chain.Add(absl::StrCat(i));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(chain.Pick());
+    }
+    state.SetLabel(absl::StrCat(chain.Len(), " items"));
+}
+BENCHMARK(BM_PickFullCycle)->RangeMultiplier(10)->Range(10000, 10000000);
+
+// Measure a Pick, and a weight update, in a weighted chain. Both should
+// grow logarithmically with the size of the chain.
+void BM_PickWeighted(benchmark::State& state) {
+    ShuffleChain chain(7, Xoshiro256(42));
+    for (int64_t i = 0; i < state.range(0); i++) {
+        chain.Add(absl::StrCat(i), 1 + i % 5);
+    }
+    size_t n = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(chain.Pick());
+        chain.SetWeight(n, 1 + n % 7);
+        n = (n + 7919) % chain.Len();
+    }
+    state.SetLabel(absl::StrCat(chain.Len(), " items"));
+}
+BENCHMARK(BM_PickWeighted)->RangeMultiplier(10)->Range(10000, 10000000);
+
+// Measure a database update that touches 50 songs: 25 are removed, and 25
+// are added. This should take the same time regardless of the chain size.
+void BM_Update(benchmark::State& state) {
+    ShuffleChain chain(7, Xoshiro256(42));
+    for (int64_t i = 0; i < state.range(0); i++) {
+        chain.Add(LibraryURI(i));
+    }
+    int64_t next = state.range(0);
+    for (auto _ : state) {
+        for (int i = 0; i < 25; i++) {
+            chain.Remove(LibraryURI(next - state.range(0)));
+            chain.Add(LibraryURI(next++));
+        }
+        benchmark::DoNotOptimize(chain.Pick());
+    }
+    state.SetLabel(absl::StrCat(chain.Len(), " items"));
+}
+BENCHMARK(BM_Update)->RangeMultiplier(10)->Range(10000, 1000000);
+
+// Measure restoring a checkpoint into a freshly loaded chain.
+void BM_RestoreState(benchmark::State& state) {
+    ShuffleChain chain(7, Xoshiro256(42));
+    for (int64_t i = 0; i < state.range(0); i++) {
+        chain.Add(LibraryURI(i));
+    }
+    (void)chain.Pick();
+    std::string checkpoint = chain.SaveState();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(chain.RestoreState(checkpoint));
+    }
+    state.SetLabel(absl::StrCat(chain.Len(), " items"));
+}
+BENCHMARK(BM_RestoreState)
+    ->RangeMultiplier(10)
+    ->Range(10000, 1000000)
+    ->Unit(benchmark::kMicrosecond);
+
+// Compare pick latency, and pool memory use, of the plain and front-coded
+// pool layouts on library-like URIs.
+void BM_PickCompression(benchmark::State& state) {
+    auto compression = static_cast<PoolCompression>(state.range(1));
+    // Heap bytes in use, as reported by glibc.
+    auto live_bytes = [] { return mallinfo2().uordblks; };
+    size_t before = live_bytes();
+    ShuffleChain chain(7, compression);
+    for (int64_t i = 0; i < state.range(0); i++) {
+        chain.Add(LibraryURI(i));
+    }
+    chain.Compact();
+    size_t used = live_bytes() - before;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(chain.Pick());
+    }
+    state.counters["pool_bytes"] = used;
+    state.counters["bytes_per_uri"] = static_cast<double>(used) / chain.Len();
+    state.SetLabel(compression == PoolCompression::kFront ? "front" : "none");
+}
+BENCHMARK(BM_PickCompression)
+    ->ArgsProduct({
+        {100000, 1000000},
+        {static_cast<int>(PoolCompression::kNone),
+         static_cast<int>(PoolCompression::kFront)},
+    });
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,153 @@
+#include "shuffle_feed.h"
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "t/chain_items.h"
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using namespace ashuffle;
+
+using ::testing::ContainerEq;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+TEST(ShuffleFeedTest, PublishesFullBatches) {
+    ShuffleChain chain;
+    ShuffleFeed feed(&chain, 3);
+
+    feed.Add("a");
+    feed.Add("b");
+    EXPECT_EQ(feed.Drain(), 0u);
+    EXPECT_EQ(chain.Len(), 0u);
+
+    feed.Add("c");
+    EXPECT_EQ(feed.Drain(), 3u);
+    EXPECT_THAT(ChainItems(chain),
+                ElementsAre(ElementsAre("a"), ElementsAre("b"),
+                            ElementsAre("c")));
+    EXPECT_FALSE(feed.Done());
+}
+
+TEST(ShuffleFeedTest, FlushAndClose) {
+    ShuffleChain chain;
+    ShuffleFeed feed(&chain, 100);
+
+    feed.Add("a");
+    feed.Flush();
+    EXPECT_EQ(feed.Drain(), 1u);
+    EXPECT_FALSE(feed.Done());
+
+    feed.Add("b");
+    feed.Close();
+    EXPECT_FALSE(feed.Done()) << "closed, but not yet drained";
+    EXPECT_EQ(feed.Drain(), 1u);
+    EXPECT_TRUE(feed.Done());
+    EXPECT_EQ(chain.Len(), 2u);
+
+    EXPECT_EQ(feed.Drain(), 0u);
+    EXPECT_TRUE(feed.Done());
+}
+
+TEST(ShuffleFeedTest, Groups) {
+    ShuffleChain chain;
+    ShuffleFeed feed(&chain);
+
+    {
+        // The feed copies items, so they may go away before they're drained.
+        std::vector<std::string> keyed{"a", "b"};
+        std::vector<std::string> unkeyed{"c", "d", "e"};
+        feed.Add(ShuffleItem(keyed, 42));
+        feed.Add(ShuffleItem(unkeyed));
+        feed.Add("f");
+        std::string keyed_single = "g";
+        feed.Add(ShuffleItem(keyed_single, 7));
+    }
+    feed.Close();
+    EXPECT_EQ(feed.Drain(), 4u);
+
+    EXPECT_THAT(ChainItems(chain),
+                ElementsAre(ElementsAre("a", "b"), ElementsAre("c", "d", "e"),
+                            ElementsAre("f"), ElementsAre("g")));
+
+    // Items keep their keys.
+    std::vector<std::string> unkeyed{"c", "d", "e"};
+    EXPECT_FALSE(chain.Remove("g")) << "single URI lost its explicit key";
+    EXPECT_TRUE(chain.Remove(42));
+    EXPECT_TRUE(chain.Remove(ShuffleItem(unkeyed).Key()));
+    EXPECT_TRUE(chain.Remove("f"));
+    EXPECT_TRUE(chain.Remove(7));
+    EXPECT_THAT(ChainItems(chain), IsEmpty());
+}
+
+// Pick from the chain while another thread loads it. Every picked item must
+// be one that was added, and every added item must end up in the chain.
+TEST(ShuffleFeedTest, ConcurrentLoad) {
+    constexpr int items = 50000;
+    ShuffleChain chain(7, Xoshiro256(1));
+    ShuffleFeed feed(&chain, 64);
+
+    std::thread producer([&feed] {
+        for (int i = 0; i < items; i++) {
+            feed.Add(absl::StrCat("song ", i));
+        }
+        feed.Close();
+    });
+
+    std::set<std::string> want;
+    for (int i = 0; i < items; i++) {
+        want.insert(absl::StrCat("song ", i));
+    }
+
+    size_t picks = 0;
+    while (!feed.Done()) {
+        feed.Drain();
+        if (chain.Len() == 0) {
+            continue;
+        }
+        std::string got(chain.Pick()[0]);
+        ASSERT_EQ(want.count(got), 1u) << got;
+        picks++;
+    }
+    producer.join();
+
+    std::set<std::string> loaded;
+    for (const std::vector<std::string>& item : ChainItems(chain)) {
+        ASSERT_EQ(item.size(), 1u);
+        loaded.insert(item[0]);
+    }
+    EXPECT_THAT(loaded, ContainerEq(want));
+    EXPECT_EQ(chain.Len(), static_cast<size_t>(items));
+    EXPECT_GT(picks, 0u);
+}
+
+TEST(ShuffleFeedTest, Wait) {
+    ShuffleChain chain;
+    ShuffleFeed feed(&chain, 100);
+
+    // Nothing is published, so this gives up right away.
+    feed.WaitUntil(std::chrono::steady_clock::now());
+    EXPECT_EQ(feed.Drain(), 0u);
+
+    std::thread producer([&feed] {
+        feed.Add("a");
+        feed.Flush();
+        feed.Add("b");
+        feed.Close();
+    });
+    feed.Wait();
+    // The first batch may be drained on its own, or with the second.
+    EXPECT_GE(feed.Drain(), 1u);
+    while (!feed.Done()) {
+        feed.Wait();
+        feed.Drain();
+    }
+    producer.join();
+    EXPECT_EQ(chain.Len(), 2u);
+}
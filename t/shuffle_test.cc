@@ -2,21 +2,31 @@
 
 #include <stdlib.h>
 #include <algorithm>
+#include <deque>
 #include <random>
+#include <set>
 #include <string>
 #include <unordered_set>
 #include <vector>
 
+#include "t/chain_items.h"
+
 #include <absl/strings/str_cat.h>
+#include <absl/types/span.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 using namespace ashuffle;
 
 using ::testing::ContainerEq;
+using ::testing::Contains;
 using ::testing::Each;
+using ::testing::IsEmpty;
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+using ::testing::Not;
 using ::testing::Range;
+using ::testing::SizeIs;
 using ::testing::Values;
 using ::testing::WhenSorted;
 
@@ -41,8 +51,8 @@ TEST(ShuffleChainTest, AddPickGroup) {
 
     EXPECT_EQ(chain.Len(), 1);
     EXPECT_EQ(chain.LenURIs(), 3);
-    EXPECT_THAT(chain.Pick(), ContainerEq(g));
-    EXPECT_THAT(chain.Pick(), ContainerEq(g))
+    EXPECT_THAT(chain.Pick(), ElementsAreArray(g));
+    EXPECT_THAT(chain.Pick(), ElementsAreArray(g))
         << "could not double-pick from the same 1-item chain.";
 }
 
@@ -61,7 +71,7 @@ TEST(ShuffleChainTest, PickN) {
 
     std::vector<std::string> picked;
     for (int i = 0; i < test_rounds; i++) {
-        const std::vector<std::string>& got = chain.Pick();
+        absl::Span<const std::string_view> got = chain.Pick();
         picked.insert(picked.end(), got.begin(), got.end());
     }
 
@@ -69,6 +79,51 @@ TEST(ShuffleChainTest, PickN) {
         << "ShuffleChain picked item not in chain!";
 }
 
+// PickN should pick exactly the same items as the equivalent number of calls
+// to Pick, given the same random state.
+TEST(ShuffleChainTest, PickNMatchesPick) {
+    for (PoolCompression compression :
+         {PoolCompression::kNone, PoolCompression::kFront}) {
+        ShuffleChain one_at_a_time(3, compression, std::mt19937(7));
+        ShuffleChain batched(3, compression, std::mt19937(7));
+        for (int i = 0; i < 20; i++) {
+            one_at_a_time.Add(absl::StrCat("item ", i));
+            batched.Add(absl::StrCat("item ", i));
+        }
+        batched.Add(std::vector<std::string>{"group a", "group b"});
+        one_at_a_time.Add(std::vector<std::string>{"group a", "group b"});
+
+        std::vector<std::string> want;
+        for (int i = 0; i < 50; i++) {
+            absl::Span<const std::string_view> got = one_at_a_time.Pick();
+            want.insert(want.end(), got.begin(), got.end());
+        }
+
+        std::vector<std::string_view> got;
+        batched.PickN(50, &got);
+        EXPECT_THAT(got, ElementsAreArray(want));
+
+        // The buffer is cleared, and re-used, by the next call.
+        batched.PickN(0, &got);
+        EXPECT_THAT(got, IsEmpty());
+    }
+}
+
+TEST(ShuffleChainTest, PickURIs) {
+    ShuffleChain chain(1);
+    chain.Add(std::vector<std::string>{"a 1", "a 2", "a 3"});
+    chain.Add(std::vector<std::string>{"b 1", "b 2", "b 3"});
+
+    // Groups are never split, so asking for 4 URIs needs both groups.
+    std::vector<std::string_view> got;
+    chain.PickURIs(4, &got);
+    EXPECT_THAT(got, WhenSorted(ElementsAre("a 1", "a 2", "a 3", "b 1", "b 2",
+                                            "b 3")));
+
+    chain.PickURIs(1, &got);
+    EXPECT_THAT(got, SizeIs(3));
+}
+
 class WindowTest : public testing::TestWithParam<int> {
    public:
     ShuffleChain chain_;
@@ -87,7 +142,7 @@ class WindowTest : public testing::TestWithParam<int> {
 TEST_P(WindowTest, Repeats) {
     // The first window_size items should all be unique, so when we check the
     // length of "picked", it should match window_size.
-    std::unordered_set<std::string> picked;
+    std::unordered_set<std::string_view> picked;
     for (int i = 0; i < WindowSize(); i++) {
         auto got = chain_.Pick();
         picked.insert(got.begin(), got.end());
@@ -108,6 +163,29 @@ TEST_P(WindowTest, Repeats) {
 INSTANTIATE_TEST_SUITE_P(SmallWindows, WindowTest, Range(1, 25 + 1));
 INSTANTIATE_TEST_SUITE_P(BigWindows, WindowTest, Values(50, 99, 100, 1000));
 
+// With more items than fit in the window, every run of window_size + 1
+// consecutive picks must still be unique, no matter how many items are
+// cycled back through the pool.
+TEST(ShuffleChainTest, NoRepeatsWithinWindow) {
+    constexpr int window = 7;
+    constexpr int items = 100;
+    ShuffleChain chain(window);
+    for (int i = 0; i < items; i++) {
+        chain.Add(absl::StrCat("item ", i));
+    }
+
+    std::deque<std::string> recent;
+    for (int i = 0; i < 10 * items; i++) {
+        std::string got(chain.Pick()[0]);
+        EXPECT_THAT(recent, Not(Contains(got)))
+            << "picked " << got << " twice within the window";
+        recent.push_back(got);
+        if (recent.size() > window) {
+            recent.pop_front();
+        }
+    }
+}
+
 // In this test we seed rand (srand) with a known value so we have
 // deterministic randomness from `rand`. These values are known to be
 // random according to `rand()` so we're just validating that `shuffle` is
@@ -134,7 +212,29 @@ TEST(ShuffleChainTest, IsRandom) {
     EXPECT_THAT(got, ContainerEq(want));
 }
 
-TEST(ShuffleChainTest, Items) {
+// Chains built with generators in the same state pick the same items, for
+// any UniformRandomBitGenerator.
+TEST(ShuffleChainTest, SeedIsReproducible) {
+    auto picks = [](ShuffleChain chain) {
+        for (int i = 0; i < 50; i++) {
+            chain.Add(absl::StrCat("song ", i));
+        }
+        std::vector<std::string> got;
+        for (int i = 0; i < 200; i++) {
+            got.emplace_back(chain.Pick()[0]);
+        }
+        return got;
+    };
+
+    EXPECT_THAT(picks(ShuffleChain(5, Xoshiro256(1))),
+                ContainerEq(picks(ShuffleChain(5, Xoshiro256(1)))));
+    EXPECT_THAT(picks(ShuffleChain(5, std::mt19937_64(1))),
+                ContainerEq(picks(ShuffleChain(5, std::mt19937_64(1)))));
+    EXPECT_THAT(picks(ShuffleChain(5, Xoshiro256(1))),
+                Not(ContainerEq(picks(ShuffleChain(5, Xoshiro256(2))))));
+}
+
+TEST(ShuffleChainTest, ForEach) {
     ShuffleChain chain(2);
 
     const std::vector<std::string> test_uris{"test a", "test b", "test c"};
@@ -151,13 +251,458 @@ TEST(ShuffleChainTest, Items) {
     // be OK, it just won't do anything.
     (void)chain.Pick();
 
-    std::vector<std::vector<std::string>> got = chain.Items();
+    // Items are visited in the order they were added.
+    std::vector<std::vector<std::string>> got = ChainItems(chain);
     std::vector<std::vector<std::string>> want = {
-        test_group,
         {"test a"},
         {"test b"},
         {"test c"},
+        test_group,
     };
 
-    EXPECT_THAT(got, WhenSorted(ContainerEq(want)));
+    EXPECT_THAT(got, ContainerEq(want));
+}
+
+TEST(ShuffleChainTest, FrontCompressed) {
+    ShuffleChain chain(2, PoolCompression::kFront);
+
+    const std::vector<std::string> test_group{"dir/group a", "dir/group b"};
+    chain.Add("dir/test a");
+    chain.Add("dir/test b");
+    chain.Add(test_group);
+    chain.Compact();
+
+    EXPECT_EQ(chain.Len(), 3);
+    EXPECT_EQ(chain.LenURIs(), 4);
+
+    std::vector<std::vector<std::string>> want = {
+        test_group,
+        {"dir/test a"},
+        {"dir/test b"},
+    };
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+
+    // The window guarantees that 3 picks return each item exactly once.
+    std::vector<std::vector<std::string>> picked;
+    for (int i = 0; i < 3; i++) {
+        absl::Span<const std::string_view> got = chain.Pick();
+        picked.emplace_back(got.begin(), got.end());
+    }
+    EXPECT_THAT(picked, WhenSorted(ContainerEq(want)));
+
+    // Items added after compaction are compressed on the next pick, along
+    // with the existing items.
+    chain.Add("dir/test c");
+    chain.Add("dir/test d");
+    want = {
+        test_group,     {"dir/test a"}, {"dir/test b"},
+        {"dir/test c"}, {"dir/test d"},
+    };
+    (void)chain.Pick();
+    EXPECT_EQ(chain.LenURIs(), 6);
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+
+    // Removed items are dropped from the dictionary once it is rebuilt.
+    EXPECT_TRUE(chain.Remove("dir/test a"));
+    EXPECT_TRUE(chain.Remove("dir/test b"));
+    EXPECT_TRUE(chain.Remove(ShuffleItem(test_group).Key()));
+    chain.Compact();
+    EXPECT_EQ(chain.LenURIs(), 2);
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ElementsAre(
+                                       ElementsAre("dir/test c"),
+                                       ElementsAre("dir/test d"))));
+}
+
+// Items are picked in proportion to their weight.
+TEST(ShuffleChainTest, Weighted) {
+    // With a window of 0, every pick is a fresh draw from the whole chain.
+    ShuffleChain chain(0, Xoshiro256(3));
+    chain.Add("light");
+    chain.Add("heavy", 3);
+    EXPECT_EQ(chain.Weight(0), 1u);
+    EXPECT_EQ(chain.Weight(1), 3u);
+
+    constexpr int kPicks = 40000;
+    int heavy = 0;
+    for (int i = 0; i < kPicks; i++) {
+        if (chain.Pick()[0] == "heavy") {
+            heavy++;
+        }
+    }
+    EXPECT_NEAR(heavy, kPicks * 3 / 4, kPicks / 100);
+
+    // Re-weighting takes effect for later picks.
+    chain.SetWeight(0, 3);
+    chain.SetWeight(1, 1);
+    heavy = 0;
+    for (int i = 0; i < kPicks; i++) {
+        if (chain.Pick()[0] == "heavy") {
+            heavy++;
+        }
+    }
+    EXPECT_NEAR(heavy, kPicks / 4, kPicks / 100);
+}
+
+// The window still prevents repeats in weighted mode, even for items that
+// are much heavier than the rest.
+TEST(ShuffleChainTest, WeightedNoRepeatsWithinWindow) {
+    constexpr int window = 7;
+    constexpr int items = 100;
+    ShuffleChain chain(window);
+    for (int i = 0; i < items; i++) {
+        chain.Add(absl::StrCat("item ", i), i % 10 == 0 ? 1000 : 1);
+    }
+
+    std::deque<std::string> recent;
+    for (int i = 0; i < 10 * items; i++) {
+        if (i == items) {
+            // Re-weight items while some of them are in the window.
+            for (int j = 0; j < items; j++) {
+                chain.SetWeight(j, j % 10 == 5 ? 1000 : 1);
+            }
+        }
+        std::string got(chain.Pick()[0]);
+        EXPECT_THAT(recent, Not(Contains(got)))
+            << "picked " << got << " twice within the window";
+        recent.push_back(got);
+        if (recent.size() > window) {
+            recent.pop_front();
+        }
+    }
+}
+
+// Switching to weighted mode after picking keeps every item reachable, and
+// does not change the items already in the window.
+TEST(ShuffleChainTest, WeightedAfterPick) {
+    ShuffleChain chain(2, Xoshiro256(5));
+    std::vector<std::string> uris = {"a", "b", "c", "d"};
+    for (const std::string& uri : uris) {
+        chain.Add(uri);
+    }
+    (void)chain.Pick();
+    chain.SetWeight(3, 2);
+    EXPECT_EQ(chain.Weight(3), 2u);
+
+    std::unordered_set<std::string_view> seen;
+    for (int i = 0; i < 100; i++) {
+        seen.insert(chain.Pick()[0]);
+    }
+    EXPECT_THAT(seen, WhenSorted(ElementsAreArray(uris)));
+}
+
+// Adding an item with the key of an existing item updates it in place.
+TEST(ShuffleChainTest, AddUpdatesExisting) {
+    ShuffleChain chain(2);
+    chain.Add("a");
+    chain.Add("b", 5);
+    chain.Add("a");
+    chain.Add("b");
+    EXPECT_EQ(chain.Len(), 2);
+    EXPECT_EQ(chain.LenURIs(), 2);
+    // Re-adding without a weight keeps the existing weight.
+    EXPECT_EQ(chain.Weight(1), 5u);
+
+    // Groups with an explicit key keep their identity when their URIs
+    // change.
+    std::vector<std::string> album = {"album/1", "album/2"};
+    chain.Add(ShuffleItem(album, 42));
+    album.push_back("album/3");
+    chain.Add(ShuffleItem(album, 42));
+    EXPECT_EQ(chain.Len(), 3);
+    EXPECT_EQ(chain.LenURIs(), 5);
+    EXPECT_THAT(ChainItems(chain),
+                ElementsAre(ElementsAre("a"), ElementsAre("b"),
+                            ElementsAre("album/1", "album/2", "album/3")));
+}
+
+TEST(ShuffleChainTest, Remove) {
+    ShuffleChain chain(1);
+    chain.Add("a");
+    chain.Add("b");
+    chain.Add("c");
+
+    EXPECT_TRUE(chain.Remove("a"));
+    EXPECT_FALSE(chain.Remove("a"));
+    EXPECT_FALSE(chain.Remove("never added"));
+    EXPECT_EQ(chain.Len(), 2);
+    EXPECT_EQ(chain.LenURIs(), 2);
+    // The last item takes the index of the removed one.
+    EXPECT_THAT(ChainItems(chain),
+                ElementsAre(ElementsAre("c"), ElementsAre("b")));
+
+    std::unordered_set<std::string_view> picked;
+    for (int i = 0; i < 10; i++) {
+        picked.insert(chain.Pick()[0]);
+    }
+    EXPECT_THAT(picked, WhenSorted(ElementsAre("b", "c")));
+
+    // Removed items can be added again.
+    chain.Add("a");
+    EXPECT_EQ(chain.Len(), 3);
+}
+
+// Removing items, including items in the window, keeps the rest of the
+// window in place.
+TEST(ShuffleChainTest, RemoveKeepsWindow) {
+    for (bool weighted : {false, true}) {
+        ShuffleChain chain(4, Xoshiro256(11));
+        for (int i = 0; i < 20; i++) {
+            chain.Add(absl::StrCat("item ", i), weighted ? 1 + i % 3 : 1);
+        }
+        // Fill the window.
+        std::string first(chain.Pick()[0]);
+
+        // Remove the next item that would be picked, and a few others.
+        ShuffleChain probe(4, Xoshiro256(11));
+        for (int i = 0; i < 20; i++) {
+            probe.Add(absl::StrCat("item ", i), weighted ? 1 + i % 3 : 1);
+        }
+        std::vector<std::string> want;
+        for (int i = 0; i < 5; i++) {
+            want.emplace_back(probe.Pick()[0]);
+        }
+        ASSERT_EQ(want[0], first);
+
+        EXPECT_TRUE(chain.Remove(want[1]));
+        for (int i = 0; i < 20; i += 5) {
+            std::string uri = absl::StrCat("item ", i);
+            if (std::find(want.begin(), want.end(), uri) == want.end()) {
+                EXPECT_TRUE(chain.Remove(uri));
+            }
+        }
+
+        // The rest of the window is picked in the same order as before.
+        for (int i = 2; i < 5; i++) {
+            EXPECT_EQ(chain.Pick()[0], want[i]) << "weighted: " << weighted;
+        }
+    }
+}
+
+TEST(ShuffleChainTest, Reload) {
+    ShuffleChain chain(2);
+    chain.Add("a");
+    chain.Add("b", 3);
+    chain.Add("c");
+
+    chain.BeginReload();
+    chain.Add("c");
+    chain.Add("b");
+    chain.Add("d");
+    EXPECT_EQ(chain.EndReload(), 1u);
+
+    EXPECT_EQ(chain.Len(), 3);
+    EXPECT_THAT(ChainItems(chain), WhenSorted(ElementsAre(ElementsAre("b"),
+                                                          ElementsAre("c"),
+                                                          ElementsAre("d"))));
+    // "b" kept its weight, since it was not re-added with a new one.
+    for (size_t i = 0; i < chain.Len(); i++) {
+        if (ChainItems(chain)[i][0] == "b") {
+            EXPECT_EQ(chain.Weight(i), 3u);
+        }
+    }
+}
+
+// Run a random sequence of adds, updates, removals, and picks, and check the
+// chain against a simple model after every step.
+TEST(ShuffleChainTest, RandomMutations) {
+    for (PoolCompression compression :
+         {PoolCompression::kNone, PoolCompression::kFront}) {
+        constexpr size_t window = 3;
+        ShuffleChain chain(window, compression, Xoshiro256(17));
+        // Tags only change which items are drawn, so they're set here to
+        // check that they're kept in step with the items.
+        chain.SetTagCooldown(2);
+        std::mt19937 ops(23);
+        std::set<std::string> model;
+        std::deque<std::string> recent;
+
+        for (int step = 0; step < 5000; step++) {
+            std::string uri = absl::StrCat("dir/item ", ops() % 40);
+            std::vector<std::string> tags(step % 3,
+                                          absl::StrCat("tag ", step % 5));
+            switch (ops() % 4) {
+                case 0:
+                    chain.Add(ShuffleItem(uri).WithTags(tags), 1 + ops() % 3);
+                    model.insert(uri);
+                    break;
+                case 1:
+                    // Removing an item from the window frees a place that is
+                    // refilled from the pool, which may hold recent picks,
+                    // so the no-repeat guarantee starts over.
+                    if (chain.Remove(uri)) {
+                        EXPECT_EQ(model.erase(uri), 1u);
+                        recent.clear();
+                    } else {
+                        EXPECT_EQ(model.count(uri), 0u);
+                    }
+                    break;
+                default:
+                    if (model.empty()) {
+                        break;
+                    }
+                    std::string got(chain.Pick()[0]);
+                    ASSERT_EQ(model.count(got), 1u) << got;
+                    // Repeats are unavoidable while the chain is no larger
+                    // than the window.
+                    if (model.size() <= window) {
+                        recent.clear();
+                        break;
+                    }
+                    EXPECT_THAT(recent, Not(Contains(got)));
+                    recent.push_back(got);
+                    if (recent.size() > window) {
+                        recent.pop_front();
+                    }
+            }
+            ASSERT_EQ(chain.Len(), model.size());
+            ASSERT_EQ(chain.LenURIs(), model.size());
+        }
+
+        std::vector<std::vector<std::string>> want;
+        for (const std::string& uri : model) {
+            want.push_back({uri});
+        }
+        EXPECT_THAT(ChainItems(chain), WhenSorted(ContainerEq(want)));
+    }
+}
+
+// A full-cycle chain picks every item exactly once per pass, and doesn't
+// repeat an item across the boundary between passes.
+TEST(ShuffleChainTest, FullCycle) {
+    constexpr int items = 50;
+    ShuffleChain chain(ShuffleChain::kFullCycle, Xoshiro256(3));
+    for (int i = 0; i < items; i++) {
+        chain.Add(absl::StrCat("item ", i));
+    }
+
+    std::string last;
+    std::vector<std::vector<std::string>> passes;
+    for (int pass = 0; pass < 5; pass++) {
+        std::vector<std::string> got;
+        for (int i = 0; i < items; i++) {
+            got.emplace_back(chain.Pick()[0]);
+        }
+        EXPECT_NE(got.front(), last);
+        last = got.back();
+        EXPECT_THAT(std::set<std::string>(got.begin(), got.end()),
+                    SizeIs(items));
+        passes.push_back(got);
+    }
+    // Each pass is shuffled anew.
+    EXPECT_THAT(passes[0], Not(ContainerEq(passes[1])));
+}
+
+// Items added during a pass are picked later in the same pass, and removed
+// items are never picked.
+TEST(ShuffleChainTest, FullCycleMutations) {
+    ShuffleChain chain(ShuffleChain::kFullCycle, Xoshiro256(5));
+    std::mt19937 ops(29);
+    std::set<std::string> model;
+    std::set<std::string> played;
+
+    for (int step = 0; step < 5000; step++) {
+        std::string uri = absl::StrCat("item ", ops() % 40);
+        switch (ops() % 4) {
+            case 0:
+                // Weights are ignored in full-cycle mode.
+                chain.Add(uri, 1 + ops() % 3);
+                model.insert(uri);
+                break;
+            case 1:
+                EXPECT_EQ(chain.Remove(uri), model.erase(uri) == 1);
+                played.erase(uri);
+                break;
+            default:
+                if (model.empty()) {
+                    break;
+                }
+                if (played.size() == model.size()) {
+                    played.clear();
+                }
+                std::string got(chain.Pick()[0]);
+                ASSERT_EQ(model.count(got), 1u) << got;
+                EXPECT_TRUE(played.insert(got).second)
+                    << "picked " << got << " twice in one pass";
+        }
+        ASSERT_EQ(chain.Len(), model.size());
+    }
+    for (size_t i = 0; i < chain.Len(); i++) {
+        EXPECT_EQ(chain.Weight(i), 1u);
+    }
+}
+
+// Returns the number of picks from `chain` whose artist (the URI up to the
+// first '/') matches one of the `cooldown` picks before it.
+static int ArtistRepeats(ShuffleChain& chain, size_t cooldown, int picks) {
+    std::deque<std::string> recent;
+    int repeats = 0;
+    for (int i = 0; i < picks; i++) {
+        std::string uri(chain.Pick()[0]);
+        std::string artist = uri.substr(0, uri.find('/'));
+        if (std::find(recent.begin(), recent.end(), artist) != recent.end()) {
+            repeats++;
+        }
+        recent.push_back(artist);
+        if (recent.size() > cooldown) {
+            recent.pop_front();
+        }
+    }
+    return repeats;
+}
+
+// Add 50 songs by one artist, and 5 songs by each of 10 other artists.
+static void AddArtists(ShuffleChain& chain,
+                       std::vector<std::vector<std::string>>& tags) {
+    tags.clear();
+    for (int i = 0; i < 100; i++) {
+        int artist = i < 50 ? 0 : 1 + (i - 50) / 5;
+        tags.push_back({absl::StrCat("artist ", artist)});
+    }
+    for (int i = 0; i < 100; i++) {
+        chain.Add(ShuffleItem(absl::StrCat(tags[i][0], "/song ", i))
+                      .WithTags(tags[i]));
+    }
+}
+
+TEST(ShuffleChainTest, TagCooldown) {
+    constexpr size_t cooldown = 3;
+    std::vector<std::vector<std::string>> tags;
+
+    ShuffleChain plain(7, Xoshiro256(11));
+    AddArtists(plain, tags);
+    ShuffleChain spread(7, Xoshiro256(11));
+    spread.SetTagCooldown(cooldown);
+    AddArtists(spread, tags);
+
+    // Half of the songs are by one artist, so without a cooldown, most
+    // picks repeat a recent artist.
+    EXPECT_GT(ArtistRepeats(plain, cooldown, 2000), 800);
+    EXPECT_LT(ArtistRepeats(spread, cooldown, 2000), 100);
+}
+
+TEST(ShuffleChainTest, TagCooldownFullCycle) {
+    constexpr size_t cooldown = 2;
+    std::vector<std::vector<std::string>> tags;
+    ShuffleChain chain(ShuffleChain::kFullCycle, Xoshiro256(13));
+    chain.SetTagCooldown(cooldown);
+    AddArtists(chain, tags);
+
+    // The cooldown can't be kept at the end of a pass, when only songs by
+    // the main artist are left, but it still never repeats a song in a pass.
+    std::set<std::string> pass;
+    std::deque<std::string> recent;
+    int repeats = 0;
+    for (int i = 0; i < 100; i++) {
+        std::string uri(chain.Pick()[0]);
+        EXPECT_TRUE(pass.insert(uri).second) << uri;
+        std::string artist = uri.substr(0, uri.find('/'));
+        if (std::find(recent.begin(), recent.end(), artist) != recent.end()) {
+            repeats++;
+        }
+        recent.push_back(artist);
+        if (recent.size() > cooldown) {
+            recent.pop_front();
+        }
+    }
+    EXPECT_LT(repeats, 50);
 }
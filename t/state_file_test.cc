@@ -0,0 +1,177 @@
+#include "state_file.h"
+
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <string>
+#include <variant>
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "random.h"
+#include "shuffle.h"
+#include "t/temp_dir.h"
+
+using namespace ashuffle;
+
+using ::testing::HasSubstr;
+
+namespace {
+
+ShuffleChain TestChain(uint64_t seed, int items = 100, size_t window = 5) {
+    ShuffleChain chain(window, Xoshiro256(seed));
+    for (int i = 0; i < items; i++) {
+        chain.Add(absl::StrCat("song ", i));
+    }
+    return chain;
+}
+
+std::vector<std::string> Picks(ShuffleChain* chain, int n) {
+    std::vector<std::string> got;
+    for (int i = 0; i < n; i++) {
+        got.emplace_back(chain->Pick()[0]);
+    }
+    return got;
+}
+
+}  // namespace
+
+// A restored chain picks the same upcoming songs as the chain it was saved
+// from, even though it was created with a different seed.
+TEST(ShuffleStateTest, RoundTrip) {
+    ShuffleChain chain = TestChain(1);
+    (void)Picks(&chain, 17);
+    std::string state = chain.SaveState();
+
+    ShuffleChain restored = TestChain(2);
+    auto result = restored.RestoreState(state);
+    ASSERT_TRUE(std::holds_alternative<ShuffleChain::RestoreResult>(result))
+        << std::get<std::string>(result);
+    auto& got = std::get<ShuffleChain::RestoreResult>(result);
+    EXPECT_EQ(got.window_saved, 5u);
+    EXPECT_EQ(got.window_restored, 5u);
+    EXPECT_FALSE(got.items_changed);
+
+    EXPECT_EQ(Picks(&restored, 5), Picks(&chain, 5));
+}
+
+// Items that are no longer in the chain are skipped, and the rest of the
+// window is restored in order.
+TEST(ShuffleStateTest, ItemsChanged) {
+    ShuffleChain chain = TestChain(1);
+    (void)Picks(&chain, 3);
+    std::string state = chain.SaveState();
+    std::vector<std::string> upcoming = Picks(&chain, 5);
+
+    ShuffleChain restored = TestChain(1);
+    ASSERT_TRUE(restored.Remove(upcoming[2]));
+    restored.Add("new song");
+    auto result = std::get<ShuffleChain::RestoreResult>(
+        restored.RestoreState(state));
+    EXPECT_EQ(result.window_saved, 5u);
+    EXPECT_EQ(result.window_restored, 4u);
+    EXPECT_TRUE(result.items_changed);
+
+    upcoming.erase(upcoming.begin() + 2);
+    EXPECT_EQ(Picks(&restored, 4), upcoming);
+}
+
+// A restored full-cycle chain finishes the saved pass, before repeating any
+// item.
+TEST(ShuffleStateTest, FullCycle) {
+    ShuffleChain chain = TestChain(1, 20, ShuffleChain::kFullCycle);
+    std::vector<std::string> played = Picks(&chain, 12);
+    std::string state = chain.SaveState();
+
+    ShuffleChain restored = TestChain(2, 20, ShuffleChain::kFullCycle);
+    auto result = std::get<ShuffleChain::RestoreResult>(
+        restored.RestoreState(state));
+    EXPECT_EQ(result.played_saved, 12u);
+    EXPECT_EQ(result.played_restored, 12u);
+    EXPECT_EQ(result.window_saved, 0u);
+    EXPECT_FALSE(result.items_changed);
+
+    std::vector<std::string> rest = Picks(&restored, 8);
+    std::set<std::string> all(played.begin(), played.end());
+    all.insert(rest.begin(), rest.end());
+    EXPECT_EQ(all.size(), 20u) << "an item was repeated within the pass";
+
+    // A window checkpoint means nothing to a full-cycle chain, and the other
+    // way around.
+    ShuffleChain windowed = TestChain(1);
+    result = std::get<ShuffleChain::RestoreResult>(
+        windowed.RestoreState(state));
+    EXPECT_EQ(result.window_saved, 0u);
+    EXPECT_EQ(result.played_saved, 0u);
+    result = std::get<ShuffleChain::RestoreResult>(
+        restored.RestoreState(windowed.SaveState()));
+    EXPECT_EQ(result.window_saved, 0u);
+    EXPECT_EQ(result.played_saved, 0u);
+}
+
+TEST(ShuffleStateTest, Malformed) {
+    ShuffleChain chain = TestChain(1);
+    std::string state = chain.SaveState();
+
+    EXPECT_THAT(std::get<std::string>(chain.RestoreState("")),
+                HasSubstr("not a shuffle state"));
+    std::string corrupt = state;
+    corrupt[10] ^= 1;
+    EXPECT_THAT(std::get<std::string>(chain.RestoreState(corrupt)),
+                HasSubstr("corrupt"));
+    EXPECT_THAT(
+        std::get<std::string>(chain.RestoreState(state.substr(0, 20))),
+        HasSubstr("corrupt"));
+}
+
+class StateFileTest : public TempDirTest {
+   public:
+    StateFileTest() : TempDirTest("state"){};
+};
+
+TEST_F(StateFileTest, MissingFile) {
+    ShuffleChain chain = TestChain(1);
+    StateFile file(path_);
+    auto result = file.Restore(&chain);
+    ASSERT_TRUE(std::holds_alternative<ShuffleChain::RestoreResult>(result));
+    EXPECT_EQ(std::get<ShuffleChain::RestoreResult>(result).window_saved, 0u);
+}
+
+TEST_F(StateFileTest, SaveRestore) {
+    ShuffleChain chain = TestChain(1);
+    (void)Picks(&chain, 10);
+    {
+        StateFile file(path_);
+        EXPECT_EQ(file.Save(chain), std::nullopt);
+    }
+    // No temporary files are left behind.
+    EXPECT_NE(access(path_.c_str(), F_OK), -1);
+    EXPECT_EQ(access((path_ + ".tmp").c_str(), F_OK), -1);
+
+    ShuffleChain restored = TestChain(2);
+    StateFile file(path_);
+    auto result = file.Restore(&restored);
+    ASSERT_TRUE(std::holds_alternative<ShuffleChain::RestoreResult>(result))
+        << std::get<std::string>(result);
+    EXPECT_EQ(Picks(&restored, 5), Picks(&chain, 5));
+}
+
+TEST_F(StateFileTest, RestoreCorrupt) {
+    std::ofstream(path_) << "garbage";
+    ShuffleChain chain = TestChain(1);
+    StateFile file(path_);
+    auto result = file.Restore(&chain);
+    ASSERT_TRUE(std::holds_alternative<std::string>(result));
+    EXPECT_THAT(std::get<std::string>(result), HasSubstr(path_));
+}
+
+TEST_F(StateFileTest, SaveFails) {
+    ShuffleChain chain = TestChain(1);
+    StateFile file(dir_ + "/missing/state");
+    std::optional<std::string> err = file.Save(chain);
+    ASSERT_TRUE(err.has_value());
+    EXPECT_THAT(*err, HasSubstr("failed to create state file"));
+}
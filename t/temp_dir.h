@@ -0,0 +1,55 @@
+#ifndef __ASHUFFLE_T_TEMP_DIR_H__
+#define __ASHUFFLE_T_TEMP_DIR_H__
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace ashuffle {
+
+// TempDirTest is a test fixture that gives each test its own temporary
+// directory, `dir_`, which is removed after the test, along with any files
+// left in it. `path_` is the path of a file in that directory, named by
+// the fixture, which the test may create.
+class TempDirTest : public testing::Test {
+   public:
+    explicit TempDirTest(std::string file_name)
+        : file_name_(std::move(file_name)){};
+
+    std::string dir_;
+    std::string path_;
+
+    void SetUp() override {
+        char tmpl[] = "/tmp/ashuffle-test.XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr) << "could not create a temp dir";
+        dir_ = tmpl;
+        path_ = dir_ + "/" + file_name_;
+    }
+
+    void TearDown() override {
+        if (dir_.empty()) {
+            return;
+        }
+        if (DIR* dir = opendir(dir_.c_str()); dir != nullptr) {
+            while (struct dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    unlink((dir_ + "/" + name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(dir_.c_str());
+    }
+
+   private:
+    std::string file_name_;
+};
+
+}  // namespace ashuffle
+
+#endif  // __ASHUFFLE_T_TEMP_DIR_H__
@@ -0,0 +1,172 @@
+#include "uri_file.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "fingerprint.h"
+#include "t/temp_dir.h"
+
+using namespace ashuffle;
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class URIFileTest : public TempDirTest {
+   public:
+    URIFileTest() : TempDirTest("uris"){};
+
+    void WriteFile(std::string_view contents) {
+        std::ofstream out(path_, std::ios::binary);
+        out << contents;
+    }
+};
+
+constexpr std::string_view kContents =
+    "song_a\nsong_b\r\n\nsong_a\nsong_c\r\nsong_b\n\n\r\n\n";
+
+TEST_F(URIFileTest, Read) {
+    std::istringstream in{std::string(kContents)};
+    URIFile file = URIFile::Read(&in);
+
+    // CRLF line endings and blank lines are skipped.
+    EXPECT_THAT(file.URIs(), ElementsAre("song_a", "song_b", "song_a",
+                                         "song_c", "song_b"));
+    ASSERT_EQ(file.Keys().size(), file.URIs().size());
+    EXPECT_EQ(file.Keys()[2], Fingerprint("song_a"));
+
+    // Deduped URIs are kept in the order they first appear.
+    file.Dedupe();
+    EXPECT_THAT(file.URIs(), ElementsAre("song_a", "song_b", "song_c"));
+    EXPECT_THAT(file.Keys(),
+                ElementsAre(Fingerprint("song_a"), Fingerprint("song_b"),
+                            Fingerprint("song_c")));
+    EXPECT_TRUE(file.Contains("song_b"));
+    EXPECT_FALSE(file.Contains("song_b\r"));
+    EXPECT_FALSE(file.Contains("song_d"));
+    EXPECT_FALSE(file.Contains(""));
+}
+
+TEST_F(URIFileTest, Open) {
+    WriteFile(kContents);
+    URIFile file = URIFile::Open(path_);
+    file.Dedupe();
+
+    EXPECT_THAT(file.URIs(), ElementsAre("song_a", "song_b", "song_c"));
+    EXPECT_TRUE(file.Contains("song_c"));
+
+    // URIs still point into the file's contents once the file is moved.
+    URIFile moved = std::move(file);
+    EXPECT_THAT(moved.URIs(), ElementsAre("song_a", "song_b", "song_c"));
+}
+
+TEST_F(URIFileTest, OpenLastLine) {
+    // The last line does not need a newline.
+    WriteFile("song_a\nsong_b");
+    EXPECT_THAT(URIFile::Open(path_).URIs(), ElementsAre("song_a", "song_b"));
+}
+
+TEST_F(URIFileTest, OpenEmpty) {
+    WriteFile("");
+    EXPECT_THAT(URIFile::Open(path_).URIs(), IsEmpty());
+    // Files that are not regular files are read, rather than mapped.
+    EXPECT_THAT(URIFile::Open("/dev/null").URIs(), IsEmpty());
+    EXPECT_THAT(URIFile::Open(dir_ + "/missing").URIs(), IsEmpty());
+}
+
+// Every URI of a large file is listed twice, and lines vary in length, so
+// that blocks and chunks end at different points within lines.
+constexpr int kLargeURIs = 200000;
+
+std::string LargeURI(int i) {
+    return absl::StrCat("music/", std::string(i % 37, 'x'), "/", i);
+}
+
+std::string LargeContents() {
+    std::string contents;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < kLargeURIs; i++) {
+            absl::StrAppend(&contents, LargeURI(i),
+                            i % 3 == 0 ? "\r\n" : "\n");
+        }
+    }
+    return contents;
+}
+
+void ExpectLarge(URIFile* file) {
+    ASSERT_EQ(file->URIs().size(), static_cast<size_t>(2 * kLargeURIs));
+    file->Dedupe();
+    ASSERT_EQ(file->URIs().size(), static_cast<size_t>(kLargeURIs));
+    for (int i = 0; i < kLargeURIs; i++) {
+        ASSERT_EQ(file->URIs()[i], LargeURI(i));
+        ASSERT_TRUE(file->Contains(LargeURI(i)));
+    }
+}
+
+TEST_F(URIFileTest, ReadLarge) {
+    // Read in several blocks.
+    std::istringstream in(LargeContents());
+    URIFile file = URIFile::Read(&in);
+    ExpectLarge(&file);
+}
+
+TEST_F(URIFileTest, ReadLongLine) {
+    // Lines may be longer than a block.
+    std::string long_uri(3 * 1024 * 1024, 'x');
+    std::istringstream in(absl::StrCat("song_a\n", long_uri, "\nsong_b"));
+    EXPECT_THAT(URIFile::Read(&in).URIs(),
+                ElementsAre("song_a", long_uri, "song_b"));
+}
+
+TEST_F(URIFileTest, OpenLarge) {
+    // Large enough to be split on several threads, if there are several
+    // CPUs.
+    WriteFile(LargeContents());
+    URIFile file = URIFile::Open(path_);
+    ExpectLarge(&file);
+}
+
+// "song_a\r\nsong_b\n\nsong_a\n", compressed with `gzip -9 -n`, and `zstd`.
+constexpr std::string_view kGzipped(
+    "\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03\x2b\xce\xcf\x4b\x8f\x4f\xe4"
+    "\xe5\x2a\x06\xd1\x49\x5c\x10\x3a\x91\x0b\x00\xed\x2b\xbb\x11\x17\x00"
+    "\x00\x00",
+    36);
+constexpr std::string_view kZstded(
+    "\x28\xb5\x2f\xfd\x24\x17\xa5\x00\x00\x60\x73\x6f\x6e\x67\x5f\x61\x0d"
+    "\x0a\x62\x0a\x61\x0a\x02\x00\x60\xf0\xae\xc2\x05\xf1\x39\x4d\x1a",
+    33);
+
+#ifdef ASHUFFLE_HAVE_ZLIB
+
+TEST_F(URIFileTest, OpenGzip) {
+    WriteFile(kGzipped);
+    URIFile file = URIFile::Open(path_);
+    EXPECT_THAT(file.URIs(), ElementsAre("song_a", "song_b", "song_a"));
+    EXPECT_EQ(file.Error(), std::nullopt);
+}
+
+TEST_F(URIFileTest, ReadTruncatedGzip) {
+    std::istringstream in{std::string(kGzipped.substr(0, 20))};
+    URIFile file = URIFile::Read(&in);
+    EXPECT_NE(file.Error(), std::nullopt);
+}
+
+#endif  // ASHUFFLE_HAVE_ZLIB
+
+#ifdef ASHUFFLE_HAVE_ZSTD
+
+TEST_F(URIFileTest, ReadZstd) {
+    std::istringstream in{std::string(kZstded)};
+    URIFile file = URIFile::Read(&in);
+    EXPECT_THAT(file.URIs(), ElementsAre("song_a", "song_b", "song_a"));
+    EXPECT_EQ(file.Error(), std::nullopt);
+}
+
+#endif  // ASHUFFLE_HAVE_ZSTD